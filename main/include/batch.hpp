@@ -0,0 +1,83 @@
+/**
+ * @file batch.hpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief Bulk translation of formulas streamed through stdin/stdout
+ */
+
+#ifndef batch_hpp
+#define batch_hpp
+
+#include "ctex.hpp"
+#include "writer.hpp"
+
+#include <istream>
+#include <memory>
+#include <string>
+
+/**
+ * @class Batch
+ * @brief Translates one formula per input line, results are written in input order
+ *
+ * Formats:
+ * @code
+ *     lines : y = sqrt(x);                           ->  \f$ y = \sqrt{x} \f$
+ *     jsonl : {"id": 7, "formula": "y = sqrt(x);"}   ->  {"id":7,"latex":"\\f$ y = \\sqrt{x} \\f$"}
+ * @endcode
+ * JSON requests may select `"style"`: `"doxygen"` (default), `"display"` or `"inline"`;
+ * responses carry `"diagnostics"` when translation reports problems and `"error"`
+ * for malformed requests. Empty JSON lines are skipped.
+ *
+ * Lines are processed in chunks: a chunk ends when it is full or when no more
+ * input is available without blocking, and output is flushed only before
+ * waiting for input, so both bulk pipes and request/response coprocesses work.
+ */
+class Batch
+{
+public:
+    /**
+     * @brief Input and output format
+     */
+    enum Format
+    {
+        ///@{
+        Lines = 0,  ///< formula per line, LaTeX per line
+        JsonLines   ///< JSON request per line, JSON response per line
+        ///@}
+    };
+    /**
+     * @brief Max number of lines translated at once
+     */
+    static const size_t chunk_size = 1024;
+public:
+    /**
+     * @param[in] ctex translator, shared between threads
+     * @param[in] threads number of translating threads, 1 - translate in the calling thread
+     */
+    Batch(std::shared_ptr<CTex> ctex, size_t threads = 1);
+    ~Batch() = default;
+public:
+    /**
+     * @brief Translate all input lines
+     * @param[in] in input stream
+     * @param[in] out output sink
+     * @param[in] format input and output format
+     * @return number of processed lines
+     */
+    size_t run(std::istream& in, Writer& out, Format format);
+private:
+    /**
+     * @brief Translate a line
+     * @param[in] line input line without the line break
+     * @param[in] format input and output format
+     * @param[out] result output line without the line break
+     * @return false if the line produces no output
+     */
+    bool translate(const std::string& line, Format format, std::string& result) const;
+private:
+    std::shared_ptr<CTex> ctex_;    ///< @brief translator
+    size_t threads_;                ///< @brief number of translating threads
+};
+
+#endif /* batch_hpp */
@@ -0,0 +1,153 @@
+/**
+ * @file ctex.h
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief C interface of libctex
+ *
+ * Usage example:
+ * @code{.c}
+ *     ctex_grammar* g = ctex_create();
+ *     char latex[256];
+ *     long n = ctex_translate(g, "y = sqrt(x);", CTEX_STYLE_DOXYGEN, latex, sizeof(latex));
+ *     // n >= sizeof(latex): the result is truncated, n + 1 bytes are required
+ *     ctex_free(g);
+ * @endcode
+ * Functions never throw; a handle may be used from several threads at once.
+ * The first ctex_create adds the lexemes of the command line tool, e.g. `fsign`.
+ * Warnings and errors are logged to the console by default, see ctex_set_log_level.
+ */
+
+#ifndef ctex_h
+#define ctex_h
+
+#include <stddef.h>
+
+/**
+ * @brief Exported functions of the shared library,
+ * CTEX_SHARED and CTEX_EXPORTS are set by cmake with BUILD_SHARED_LIBS
+ */
+#if defined(CTEX_SHARED)
+#  if defined(_WIN32)
+#    if defined(CTEX_EXPORTS)
+#      define CTEX_API __declspec(dllexport)
+#    else
+#      define CTEX_API __declspec(dllimport)
+#    endif
+#  else
+#    define CTEX_API __attribute__((visibility("default")))
+#  endif
+#else
+#  define CTEX_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Opaque translator handle: grammar, caches and formula detector
+ */
+typedef struct ctex_grammar ctex_grammar;
+
+/**
+ * @brief Equation tags around translations
+ */
+enum ctex_style
+{
+    CTEX_STYLE_DOXYGEN = 0,     /**< doxygen formula */
+    CTEX_STYLE_DISPLAY = 1,     /**< LaTeX display math */
+    CTEX_STYLE_INLINE = 2       /**< LaTeX inline math */
+};
+
+/**
+ * @brief Lowest severity of logged messages
+ */
+enum ctex_log_level
+{
+    CTEX_LOG_TRACE = 0,         /**< everything */
+    CTEX_LOG_DEBUG = 1,         /**< debugging messages and above */
+    CTEX_LOG_INFO = 2,          /**< progress notifications and above */
+    CTEX_LOG_WARN = 3,          /**< warnings and errors */
+    CTEX_LOG_ERROR = 4,         /**< errors only */
+    CTEX_LOG_OFF = 5            /**< no log output */
+};
+
+/**
+ * @brief Version of the interface, increased on incompatible changes
+ */
+#define CTEX_API_VERSION 1
+
+/**
+ * @brief Version of the interface the library is built with
+ */
+CTEX_API int ctex_api_version(void);
+
+/**
+ * @brief Create translator with the default grammar
+ * @return handle or NULL on failure
+ */
+CTEX_API ctex_grammar* ctex_create(void);
+
+/**
+ * @brief Release translator, NULL is ignored
+ */
+CTEX_API void ctex_free(ctex_grammar* grammar);
+
+/**
+ * @brief Set console logging of the process, log output is shared with the host
+ * program if it uses the same logger
+ * @param[in] level one of ctex_log_level
+ * @return 0 on success or -1 if the level is unknown
+ */
+CTEX_API int ctex_set_log_level(int level);
+
+/**
+ * @brief Translate C formula to LaTeX
+ * @param[in] grammar translator
+ * @param[in] formula zero terminated C formula
+ * @param[in] style one of ctex_style
+ * @param[out] buffer receives zero terminated result, may be NULL if capacity is 0
+ * @param[in] capacity buffer size in bytes
+ * @return result length without terminator or -1 on failure;
+ * result is truncated if the length is not less than capacity
+ */
+CTEX_API long ctex_translate(ctex_grammar* grammar, const char* formula, int style,
+                             char* buffer, size_t capacity);
+
+/**
+ * @brief Translate several formulas
+ *
+ * Results are stored one after another, each is zero terminated.
+ * @param[in] grammar translator
+ * @param[in] formulas zero terminated C formulas
+ * @param[in] count number of formulas
+ * @param[in] style one of ctex_style
+ * @param[in] threads number of translating threads, 0 or 1 - calling thread
+ * @param[out] buffer receives results, may be NULL if capacity is 0
+ * @param[in] capacity buffer size in bytes
+ * @param[out] offsets receives offset of each result in buffer, may be NULL
+ * @return total size of results including terminators or -1 on failure;
+ * nothing is stored if the size exceeds capacity
+ */
+CTEX_API long ctex_translate_batch(ctex_grammar* grammar, const char* const* formulas, size_t count,
+                                   int style, size_t threads, char* buffer, size_t capacity, size_t* offsets);
+
+/**
+ * @brief Process C source like the command line tool does
+ * @param[in] grammar translator
+ * @param[in] source C source
+ * @param[in] size source size in bytes
+ * @param[out] buffer receives zero terminated result, may be NULL if capacity is 0
+ * @param[in] capacity buffer size in bytes
+ * @return result length without terminator or -1 on failure;
+ * result is truncated if the length is not less than capacity
+ */
+CTEX_API long ctex_process(ctex_grammar* grammar, const char* source, size_t size,
+                           char* buffer, size_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ctex_h */
@@ -10,10 +10,16 @@
 #define ctex_hpp
 
 #include "lexeme.hpp"
+#include "diskcache.hpp"
+#include "sharedcache.hpp"
+#include "lrucache.hpp"
 
 #include <string>
 #include <vector>
 #include <regex>
+#include <memory>
+#include <mutex>
+#include <atomic>
 
 /**
  * @brief Formla parser and converter from C language into LaTeX.
@@ -30,6 +36,29 @@ public:
         INLINE,     ///< $
         DOXYFILE    ///< /f$
     };
+    /**
+     * @brief Result of a single formula conversion
+     */
+    struct Translation
+    {
+        std::string latex;                          ///< @brief converted formula wrapped in tags
+        std::unordered_map<std::string, int> hits;  ///< @brief hit count of each regex group
+        std::vector<std::string> diagnostics;       ///< @brief errors met during conversion
+        /**
+         * @brief Get hit count for specified group
+         * @return 0 if group is unknown
+         */
+        int group_hits(const std::string& group) const;
+    };
+    /**
+     * @brief Memoization statistics
+     */
+    struct MemoStats
+    {
+        uint64_t hits;      ///< @brief translations taken from memo
+        uint64_t misses;    ///< @brief translations performed
+        size_t size;        ///< @brief number of memorized translations
+    };
 public:
     /**
      * @param[in] identified_regs regular expressions for formula parsing in format {<regex>, <group>}
@@ -62,14 +91,61 @@ public:
      * @brief Convert C formula to LaTeX
      * @param[in] in text, that contains formula
      * @param[in] style tag style
-     * @return converted formula
+     * @return converted formula, group statistics and diagnostics
      * @see EQUATION_TAG_STYLE
      */
-    std::string translate(const std::string& in, EQUATION_TAG_STYLE style = DOXYFILE);
+    Translation translate(const std::string& in, EQUATION_TAG_STYLE style = DOXYFILE);
     /**
-     * @brief Get hit count for specified group
+     * @brief Get hit count for specified group from the last translation
      */
     int group_hits(const std::string& group);
+    /**
+     * @brief Compile the grammar ahead of the first translation
+     * @return false if the grammar is invalid
+     */
+    bool prepare();
+    /**
+     * @brief Hash of everything, that affects translation result:
+     * grammar, lexeme library and output format
+     */
+    uint64_t fingerprint() const;
+    /**
+     * @brief Checks whether the grammar is default_regex()
+     * of the lexeme library at construction time
+     */
+    bool default_grammar() const;
+    /**
+     * @brief Use persistent cache of translations
+     *
+     * The cache is consulted before the formula is analyzed. Formulas are
+     * looked up by their text with whitespace runs squeezed, and by fingerprint,
+     * so one cache file may be shared between different grammars.
+     * @param[in] cache opened cache or nullptr to disable caching
+     * @see DiskCache
+     */
+    void set_disk_cache(std::shared_ptr<DiskCache> cache);
+    /**
+     * @brief Share translations with concurrent ctex processes
+     *
+     * The shared cache is consulted before the persistent one; translations
+     * found in or produced without it are published for other processes.
+     * @param[in] cache attached cache or nullptr to disable sharing
+     * @see SharedCache
+     */
+    void set_shared_cache(std::shared_ptr<SharedCache> cache);
+    /**
+     * @brief Memorize translations in memory
+     *
+     * Translations are looked up by the token sequence, so formulas,
+     * which differ only in whitespaces (`a*b` and `a * b`), share an entry.
+     * The memo is safe to use from concurrent translations.
+     * @param[in] capacity max number of memorized translations, 0 disables memo
+     */
+    void set_memo_capacity(size_t capacity);
+    /**
+     * @brief Get memoization statistics
+     */
+    MemoStats memo_stats() const;
 private:
     /**
      * @brief Analyze tokens and convert formulas to LaTeX format
@@ -77,6 +153,17 @@ private:
      * @return conversion result
      */
     std::string translate(const std::vector<std::string>& tokens);
+    /**
+     * @brief Follow changes of the lexeme library: rebuild cache keys,
+     * expire memoized translations
+     * @note costs one atomic load, unless the library changed
+     */
+    void check_revision();
+    /**
+     * @brief Remember group statistics of the last translation
+     * @see group_hits
+     */
+    void save_hits(const std::unordered_map<std::string, int>& hits);
     /**
      * @brief match index from grouped_regs_
      * @param[in] it current match iterator
@@ -86,9 +173,15 @@ private:
     /**
      * @brief Devide text in tokens
      * @param[in] in text, that contains formula
+     * @param[out] result receives group statistics and diagnostics
      * @return tokens
      */
-    std::vector<std::string> lexical_analyzer(const std::string& in);
+    std::vector<std::string> lexical_analyzer(const std::string& in, Translation& result);
+    /**
+     * @brief Compiled regex expression, built on the first call
+     * @throw std::regex_error if expression is invalid
+     */
+    std::shared_ptr<const std::regex> grammar();
     /**
      * Open tag for LaTeX math equation
      * @param style tag style
@@ -111,6 +204,19 @@ private:
      * @brief Statistics of each regex group hits
      */
     std::unordered_map<std::string, int>  grouped_hits_;
+    mutable std::mutex hits_lock_;              ///< @brief guards grouped_hits_
+    std::shared_ptr<const std::regex> grammar_; ///< @brief compiled regex_txt_ or nullptr
+    std::mutex grammar_lock_;                   ///< @brief guards grammar_
+    std::shared_ptr<DiskCache> disk_cache_;     ///< @brief persistent cache or nullptr
+    std::shared_ptr<SharedCache> shared_cache_; ///< @brief cross-process cache or nullptr
+    /**
+     * @brief Translations by token sequence or nullptr
+     */
+    std::shared_ptr<LruCache<std::string>> memo_;
+    std::atomic<uint64_t> cache_seed_;          ///< @brief fingerprint used to build cache keys
+    std::atomic<uint64_t> revision_;            ///< @brief library revision of cache_seed_ and memo_
+    std::mutex revision_lock_;                  ///< @brief serializes check_revision updates
+    bool default_grammar_;                      ///< @brief grouped_regs_ is default_regex()
 };
     
 #endif /* ctex_hpp */
@@ -10,7 +10,14 @@
 #define detector_hpp
 
 #include "ctex.hpp"
+#include "writer.hpp"
+#include "manifest.hpp"
+#include "fileio.hpp"
+#include <istream>
 #include <memory>
+#include <unordered_map>
+#include <functional>
+#include <mutex>
 
 /**
  * @class Detector
@@ -18,11 +25,30 @@
  */
 class Detector
 {
+public:
+    /**
+     * @brief Creates CTex instance on demand
+     */
+    typedef std::function<std::shared_ptr<CTex>()> Factory;
+    /**
+     * @brief Detected formula
+     */
+    struct Statement
+    {
+        size_t line;            ///< @brief zero based line, where the formula starts
+        size_t lines;           ///< @brief number of lines, the formula spans
+        std::string formula;    ///< @brief formula without comments, joined into one line
+    };
 public:
     /**
      * @param[in] ctex CTex instance to perform conversion from C to TeX
      */
     Detector(std::shared_ptr<CTex> ctex);
+    /**
+     * @brief Detector, that builds the grammar only when the first formula is found
+     * @param[in] factory creates CTex instance to perform conversion from C to TeX
+     */
+    Detector(Factory factory);
     ~Detector() = default;
     
     /**
@@ -31,25 +57,151 @@ public:
      * @param[in] min_fn_count min function count
      */
     void set_filter(int min_op_count, int min_fn_count);
+    /**
+     * @brief Set manifest to skip files, that are up to date
+     * @param[in] manifest manifest shared between detectors or nullptr
+     * @see Manifest
+     */
+    void set_manifest(std::shared_ptr<Manifest> manifest);
+    /**
+     * @brief Hash of the settings, that affect output: CTex fingerprint and filter
+     */
+    uint64_t fingerprint() const;
 public:
     /**
      * @brief Parse file stream with C code to detect convertable formulas and
      * write them to output stream
      * @param[in] in input stream
      * @param[in] out output stream
+     * @note output is buffered and flushed once the input is processed
+     */
+    void perform(std::istream& in, std::ostream& out);
+    /**
+     * @brief Process C source file and write the result to another file
+     *
+     * The input file is memory mapped, unchanged source lines are passed to
+     * the output without copying (see Writer::write_ref).
+     * When manifest is set, the file is skipped if neither input, settings,
+     * nor the previously written output changed.
+     * @param[in] in_filename input file name
+     * @param[in] out_filename output file name
+     * @return false if a file can't be opened or written
+     */
+    bool perform(const std::string& in_filename, const std::string& out_filename);
+    /**
+     * @brief Process C source file and write the result to output sink
+     * @param[in] in_filename input file name
+     * @param[in] out output sink, flushed before return
+     * @return false if the file can't be opened or the result written
+     */
+    bool perform(const std::string& in_filename, Writer& out);
+    /**
+     * @brief Process C source file in place
+     *
+     * The file is replaced atomically and only when the result differs
+     * from its content, so modification time of unchanged files is preserved.
+     * When manifest is set, the file is skipped if it is the output of
+     * the previous run with the same settings.
+     * @param[in] filename file to process
+     * @param[out] changed whether file content was changed
+     * @return false if the file can't be read or replaced
+     */
+    bool perform_in_place(const std::string& filename, bool& changed);
+    /**
+     * @brief Parse C code in memory to detect convertable formulas and
+     * write them to output sink
+     * @param[in] data input text, must stay valid until out is flushed
+     * @param[in] size input size in bytes
+     * @param[in] out output sink
      */
-    void perform(std::ifstream& in, std::ofstream& out);
+    void perform(const char* data, size_t size, Writer& out);
+    /**
+     * @brief Find formulas in C code without translating them
+     * @param[in] data input text
+     * @param[in] size input size in bytes
+     * @return formulas in input order
+     */
+    std::vector<Statement> statements(const char* data, size_t size);
+    /**
+     * @brief Translate formula, if it passes the filter
+     * @param[in] formula formula to translate
+     * @param[in] style equation tags of the translation
+     * @param[out] result translation, left empty when the filter rejects the formula early
+     * @return false if the formula has too few operations and functions
+     * @see set_filter
+     */
+    bool translate(const std::string& formula, CTex::EQUATION_TAG_STYLE style, CTex::Translation& result);
+    /**
+     * @brief CTex instance, created by factory on the first call
+     */
+    CTex& translator() const;
 private:
+    /**
+     * @brief Scan C code for formulas
+     * @param[in] data input text, must stay valid until out is flushed
+     * @param[in] size input size in bytes
+     * @param[in] out output sink or nullptr to skip output and translation
+     * @param[out] found receives detected formulas or nullptr
+     */
+    void scan(const char* data, size_t size, Writer* out, std::vector<Statement>* found);
     /**
      * @brief Process detected formula, apply filter, write to stream
      * @param[in] formula detected formula
-     * @param[in] stream  output stream
+     * @param[in] header  first line of the block, carries the fingerprint
+     * @param[in] stream  output sink
+     */
+    void process(const std::string& formula, const std::string& header, Writer& stream);
+    /**
+     * @brief Process mapped input and write the result to file
+     * @param[in] in input file
+     * @param[in] in_filename input file name
+     * @param[in] out_filename output file name, may be the input file
+     * @return false if output can't be written
      */
-    void process(const std::string& formula, std::ofstream& stream);
+    bool write_file(const MappedFile& in, const std::string& in_filename, const std::string& out_filename);
+    /**
+     * @brief Cheap filter check, performed before translation
+     *
+     * Counts operator characters and positions, where a function name starts.
+     * Both counts are upper bounds of the corresponding group hits of the
+     * default grammar, so formulas rejected here would be rejected after
+     * translation too. Other grammars skip the check.
+     * @param[in] formula detected formula
+     * @return false if formula can't pass the filter
+     */
+    bool may_pass_filter(const std::string& formula) const;
+    /**
+     * @brief Collect operator characters and function names of the lexeme
+     * library, if the translator uses the default grammar
+     * @note called once, when the translator is created
+     */
+    void init_prefilter() const;
+    /**
+     * @brief Recognise comment block generated by the previous run
+     *
+     * The block may be preceded by an empty line, that is a part of the block.
+     * @param[in] begin beginning of the line to check
+     * @param[in] end end of the input
+     * @param[out] block_end position after the block
+     * @param[out] block_header first line of the block with the fingerprint of the settings
+     * @param[out] input formula stored in the block
+     * @return true if the block starts at begin
+     */
+    bool find_block(const char* begin, const char* end, const char*& block_end,
+                    std::string& block_header, std::string& input) const;
 private:
     int min_op_count_;              ///< @brief min operation count
     int min_fn_count_;              ///< @brief min function count
-    std::shared_ptr<CTex> ctex_;    ///< @brief CTex instance
+    mutable std::shared_ptr<CTex> ctex_;    ///< @brief CTex instance
+    Factory factory_;                       ///< @brief creates ctex_ on demand
+    mutable std::once_flag ctex_once_;      ///< @brief guards ctex_ creation
+    std::shared_ptr<Manifest> manifest_;    ///< @brief processed files or nullptr
+    mutable bool prefilter_;                ///< @brief may_pass_filter is valid for the grammar
+    mutable std::string op_chars_;  ///< @brief characters, that operations consist of
+    /**
+     * @brief Supported function names grouped by the first character
+     */
+    mutable std::unordered_map<char, std::vector<std::string>> functions_;
 };
 
 #endif /* detector_hpp */
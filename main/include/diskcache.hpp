@@ -0,0 +1,141 @@
+/**
+ * @file diskcache.hpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief Persistent cache of formula translations
+ */
+
+#ifndef diskcache_hpp
+#define diskcache_hpp
+
+#include "fileio.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+/**
+ * @class DiskCache
+ * @brief Persistent cache of formula translations
+ *
+ * The cache file is memory mapped and looked up in place:
+ * @code
+ *     header  : magic, byte order mark, entry count, generation, data size
+ *     index   : { key, generation, offset, size } sorted by key
+ *     data    : { text, group hits, latex } records
+ * @endcode
+ * New entries are kept in memory until save, which merges them with
+ * the entries of the current file and drops entries, that were not used
+ * for the longest time (by generation), to keep the data within the size limit.
+ * Saves are serialized with a lock file, so concurrent runs don't lose
+ * each other's entries, and the file is replaced atomically, so they never
+ * see partial data.
+ */
+class DiskCache
+{
+public:
+    /**
+     * @brief Cached translation
+     */
+    struct Value
+    {
+        std::string latex;      ///< @brief translation without equation tags
+        std::vector<int> hits;  ///< @brief hit count of each regex group in grammar order
+    };
+    /**
+     * @brief Default data size limit in bytes
+     */
+    static const size_t default_max_size = 64 << 20;
+public:
+    /**
+     * @param[in] max_size data size limit in bytes
+     */
+    explicit DiskCache(size_t max_size = default_max_size);
+    ~DiskCache() = default;
+    
+    DiskCache(const DiskCache&) = delete;
+    DiskCache& operator=(const DiskCache&) = delete;
+public:
+    /**
+     * @brief Open cache file, missing or malformed file results in empty cache
+     * @param[in] filename cache file name
+     * @return false if existing file can't be used
+     */
+    bool open(const std::string& filename);
+    /**
+     * @brief Write the cache back to the file it was opened from
+     *
+     * Entries saved by other runs since open are kept.
+     * The file is not touched, if no entry was added or used.
+     * @return true on success
+     */
+    bool save();
+    /**
+     * @brief Find translation
+     * @param[in] key hash of the text and the grammar
+     * @param[in] text normalized formula, protects from hash collisions
+     * @param[out] value found translation
+     * @return true on hit
+     */
+    bool lookup(uint64_t key, const std::string& text, Value& value);
+    /**
+     * @brief Store translation
+     * @param[in] key hash of the text and the grammar
+     * @param[in] text normalized formula
+     * @param[in] value translation
+     */
+    void store(uint64_t key, const std::string& text, const Value& value);
+    /**
+     * @brief Number of entries
+     */
+    size_t size() const;
+    /**
+     * @brief Serialize record: { text size, text, hits count, hits, latex size, latex }
+     * @note the record format is shared with SharedCache
+     */
+    static std::string pack(const std::string& text, const Value& value);
+    /**
+     * @brief Deserialize record
+     * @return false if record is malformed or describes another text
+     */
+    static bool unpack(const char* data, size_t size, const std::string& text, Value& value);
+private:
+    /**
+     * @brief Index entry as stored in the file
+     */
+    struct IndexEntry
+    {
+        uint64_t key;           ///< hash of the text and the grammar
+        uint64_t generation;    ///< generation of the last use
+        uint32_t offset;        ///< record offset in data section
+        uint32_t size;          ///< record size
+    };
+    /**
+     * @brief Find entry in the mapped index
+     * @return entry index or -1
+     */
+    long find_mapped(uint64_t key) const;
+private:
+    size_t max_size_;           ///< @brief data size limit
+    std::string filename_;      ///< @brief cache file name
+    MappedFile file_;           ///< @brief mapped cache file
+    const char* index_;         ///< @brief mapped index
+    const char* data_;          ///< @brief mapped data section
+    size_t count_;              ///< @brief number of mapped entries
+    size_t data_size_;          ///< @brief mapped data size
+    uint64_t generation_;       ///< @brief current generation
+    /**
+     * @brief Generations of mapped entries used in this run by entry index
+     */
+    std::unordered_map<size_t, uint64_t> used_;
+    /**
+     * @brief Entries added in this run: key -> packed record
+     */
+    std::unordered_map<uint64_t, std::string> added_;
+    mutable std::mutex lock_;   ///< @brief guards used_ and added_
+};
+
+#endif /* diskcache_hpp */
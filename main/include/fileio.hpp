@@ -0,0 +1,87 @@
+/**
+ * @file fileio.hpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief File access helpers
+ */
+
+#ifndef fileio_hpp
+#define fileio_hpp
+
+#include <string>
+
+/**
+ * @class MappedFile
+ * @brief Read-only view of a whole file
+ *
+ * The file is memory mapped where possible,
+ * otherwise its content is read into memory.
+ */
+class MappedFile
+{
+public:
+    MappedFile();
+    /**
+     * @param[in] filename file to open
+     * @see good
+     */
+    explicit MappedFile(const std::string& filename);
+    ~MappedFile();
+    
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+public:
+    /**
+     * @brief Open file, previous one is closed
+     * @param[in] filename file to open
+     * @return true on success
+     */
+    bool open(const std::string& filename);
+    /**
+     * @brief Release file view
+     */
+    void close();
+    /**
+     * @brief Checks whether file was opened successfully
+     */
+    bool good() const;
+    /**
+     * @brief File content
+     */
+    const char* data() const;
+    /**
+     * @brief File size in bytes
+     */
+    size_t size() const;
+private:
+    const char* data_;      ///< @brief file content
+    size_t size_;           ///< @brief file size
+    bool mapped_;           ///< @brief whether data_ is mapped
+    bool good_;             ///< @brief file opened
+    std::string content_;   ///< @brief file content, when mapping is not available
+};
+
+namespace fileio
+{
+    /**
+     * @brief Replace file content atomically
+     *
+     * Content is written to a temporary file in the same directory,
+     * which is then renamed over the target. Symbolic links are followed,
+     * so the link target is replaced. File permissions, owner and group
+     * are preserved; a file, whose owner can't be preserved, is not replaced.
+     * @param[in] filename file to replace
+     * @param[in] data new content
+     * @param[in] size content size in bytes
+     * @return true on success, target is left untouched otherwise
+     */
+    bool replace(const std::string& filename, const char* data, size_t size);
+    /**
+     * @brief Checks whether both names refer to the same existing file,
+     * e.g. through a link or a different path
+     */
+    bool same_file(const std::string& first, const std::string& second);
+}
+
+#endif /* fileio_hpp */
@@ -7,6 +7,12 @@
  * Usage:
  * Add `#define __glogger_implementation__` before you include
  * this file in ONE C or C++ file to create the implementation.
+ *
+ * Define `GLOGGER_MIN_LEVEL` (a `GLogger::Level` value, 0 by default) equally
+ * for all files to compile out messages of lower levels.
+ *
+ * Define `GLOGGER_SCOPE_HOOK()` to run a statement, e.g. a profiling scope,
+ * in front of messages of GLOG_TRACE and GLOG_DEBUG.
  */
 
 #ifndef __glogger_hpp__
@@ -16,8 +22,44 @@
 #include <fstream>
 #include <sstream>
 #include <mutex>
+#include <atomic>
 #include <chrono>
 #include <ctime>
+#include <memory>
+#include <thread>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#ifndef GLOGGER_MIN_LEVEL
+#define GLOGGER_MIN_LEVEL 0     ///< lowest level, that is compiled in
+#endif
+
+/**
+ * @brief Statement in the scope of a GLOG_TRACE or GLOG_DEBUG message, that is written;
+ * expanded where the macros are used, so it may be redefined after this file is included
+ */
+#ifndef GLOGGER_SCOPE_HOOK
+#define GLOGGER_SCOPE_HOOK() ((void)0)
+#endif
+
+/**
+ * @brief Log with trace level, arguments are not evaluated
+ * if the level is compiled out
+ */
+#define GLOG_TRACE(...) \
+    do { if (GLogger::compiled(GLogger::Trace) && GLogger::instance().enabled(GLogger::Trace)) \
+         { GLOGGER_SCOPE_HOOK(); GLogger::instance().logTrace(__VA_ARGS__); } } while (0)
+/**
+ * @brief Log with debug level, arguments are not evaluated
+ * if the level is compiled out
+ */
+#define GLOG_DEBUG(...) \
+    do { if (GLogger::compiled(GLogger::Debug) && GLogger::instance().enabled(GLogger::Debug)) \
+         { GLOGGER_SCOPE_HOOK(); GLogger::instance().logDebug(__VA_ARGS__); } } while (0)
 
 /**
  * @class GLogger
@@ -38,8 +80,13 @@
  *         GLogger::instance().set_min_level(GLogger::Output::Console, GLogger::Level::Info);  // min console level
  *         GLogger::instance().set_min_level(GLogger::Output::File, GLogger::Level::Trace);    // min file level
  *         GLogger::instance().set_max_log_file_size(2000000);         // max log file size in bytes, 2Mb
+ *         GLogger::instance().set_max_log_files(5);                   // keep glogger.log.1 ... glogger.log.5
  *         GLogger::instance().set_log_filename("glogger.log");        // log file name
  *         //...
+ *         // callable arguments are evaluated only if the message is written
+ *         GLogger::instance().logDebug("tree:\n", [&]() { return tree.display(); });
+ *         // write from a background thread, callers never wait for I/O
+ *         GLogger::instance().start_async(4096, GLogger::Count);
  *         try
  *         {
  *           //...
@@ -61,7 +108,7 @@ public:
      * @brief Get single instance of GLogger
      */
     static GLogger& instance();
-    ~GLogger() = default;
+    ~GLogger();
 public:
     /**
      * @brief Output logger mode
@@ -89,6 +136,17 @@ public:
         None        ///< invariant to level (e.g. greeting message)
         ///@}
     };
+    /**
+     * @brief Behaviour of asynchronous logging when the queue is full
+     */
+    enum Overflow : unsigned int
+    {
+        ///@{
+        Block = 0,  ///< wait for the writer
+        Drop,       ///< discard the message
+        Count       ///< discard the message, the writer logs the number of discarded ones
+        ///@}
+    };
     
     /**
      * @brief Set output logger mode
@@ -108,17 +166,28 @@ public:
      * @brief Set log filename to begin file logging
      * @param[in] filename log file name
      * @note If file size exceeds max_log_file_size_,
-     * new log file will be created
+     * the file is rotated
+     * @see set_max_log_files
      */
     void set_log_filename(const std::string& filename);
     /**
      * @brief Set max log file size
-     * @param[in] size max log file size in bytes
+     * @param[in] size max log file size in bytes, 0 - unlimited
      *
-     * If file size exceeds max_log_file_size_,
-     * new log file will be created.
+     * When a write makes the file exceed max_log_file_size_,
+     * the file is rotated.
+     * @see set_max_log_files
      */
     void set_max_log_file_size(size_t size);
+    /**
+     * @brief Set number of rotated log files to keep
+     * @param[in] count number of generations, 5 by default
+     *
+     * Rotation renames `name.(N-1)` to `name.N`, ..., `name` to `name.1`
+     * and starts an empty `name`; the oldest generation is removed.
+     * When a file can't be renamed, `name` is kept and appended to.
+     */
+    void set_max_log_files(size_t count);
     /**
      * @brief Skip empty messages
      * param[in] flag skip or allow
@@ -135,18 +204,109 @@ public:
      */
     void set_separator(const std::string& separator);
     /**
-     * @brief Begin recording log messages
-     * @note Recording uses the same min log level as console
+     * @brief Set how often wall clock timestamps are refreshed
+     * @param[in] tick refresh interval, 1 second by default;
+     * shorter ticks add milliseconds, microseconds or nanoseconds to timestamps
+     */
+    void set_timestamp_tick(std::chrono::nanoseconds tick);
+    /**
+     * @brief Use monotonic timestamps: seconds since the logger start
+     * with nanosecond resolution instead of wall clock time
+     * param[in] flag enable/disable
+     */
+    void set_monotonic_timestamps(bool flag);
+    /**
+     * @brief Write file target messages in binary form instead of the text log file
+     * @param[in] filename binary log file name, empty to return to the text log
+     *
+     * Arguments are stored as raw values, string literals once per file,
+     * so no text is formatted for messages, that only go to the file.
+     * Messages are not trimmed or skipped if empty.
+     * @see decode_binary
+     */
+    void set_binary_log_filename(const std::string& filename);
+    /**
+     * @brief Render binary log as text log lines
+     * @param[in] in binary log
+     * @param[out] out receives text
+     * @return false if the input is not a binary log or is damaged
+     */
+    static bool decode_binary(std::istream& in, std::ostream& out);
+    /**
+     * @brief Keep recent messages of every thread in memory
+     * @param[in] records ring size per thread, 0 disables
+     *
+     * Messages of all levels are kept, including those below output levels,
+     * without any I/O. An Error message writes the messages of its thread,
+     * that the log did not get because of their level, to the log file first,
+     * so the file gets trace context only when it is needed.
+     * @see dump_flight_recorder
+     */
+    void set_flight_recorder(size_t records);
+    /**
+     * @brief Write rings of all threads to the log file
+     * @note Does not wait for locks, so it may be called from a std::terminate
+     * handler; rings, that are busy, are skipped. It allocates and uses streams,
+     * so it must not be called from a signal handler
+     */
+    void dump_flight_recorder();
+    /**
+     * @brief Begin recording log messages of the calling thread
+     * @note Recording uses the same min log level as console;
+     * threads record independently
      * @see end_record
      */
     void start_record();
     /**
-     * @brief Stop recording log messages
+     * @brief Stop recording log messages of the calling thread
      * @return string with recorded log messages
-     * @note must be called after start_record
+     * @note must be called after start_record in the same thread
      * @see start_record
      */
     std::string end_record();
+    /**
+     * @brief Start asynchronous logging
+     * @param[in] capacity queue size in messages, rounded up to a power of two
+     * @param[in] policy behaviour when the queue is full
+     *
+     * Messages are formatted by callers and passed through a lock-free queue
+     * to a background thread, that writes them to sinks in batches.
+     * @note Call when no other thread logs, as other settings
+     */
+    void start_async(size_t capacity = 4096, Overflow policy = Block);
+    /**
+     * @brief Write queued messages and stop asynchronous logging
+     * @note Call when no other thread logs, as other settings
+     */
+    void stop_async();
+    /**
+     * @brief Write messages logged before the call to sinks
+     * @note Waits for the writer in the asynchronous mode
+     */
+    void flush();
+    /**
+     * @brief Number of messages discarded since start_async
+     */
+    uint64_t dropped() const;
+    /**
+     * @brief Checks whether messages of the level reach any output
+     * @param[in] level log level
+     * @note Costs a single relaxed atomic load, so it may guard
+     * preparation of expensive messages
+     */
+    bool enabled(Level level) const
+    {
+        return compiled(level) && level >= min_level_.load(std::memory_order_relaxed);
+    }
+    /**
+     * @brief Checks whether messages of the level are compiled in
+     * @param[in] level log level
+     * @see GLOGGER_MIN_LEVEL
+     */
+    static constexpr bool compiled(Level level)
+    {
+        return level >= GLOGGER_MIN_LEVEL;
+    }
 public:
     /**
      * @brief Logging without level
@@ -166,7 +326,8 @@ public:
     template<typename ...Args>
     void logTrace(Args&&... args)
     {
-        inner_log(Trace, std::forward<Args>(args)...);
+        if (compiled(Trace))
+            inner_log(Trace, std::forward<Args>(args)...);
     }
     /**
      * @brief Logging with debug level
@@ -176,7 +337,8 @@ public:
     template<typename ...Args>
     void logDebug(Args&&... args)
     {
-        inner_log(Debug, std::forward<Args>(args)...);
+        if (compiled(Debug))
+            inner_log(Debug, std::forward<Args>(args)...);
     }
     /**
      * @brief Logging with info level
@@ -186,7 +348,8 @@ public:
     template<typename ...Args>
     void logInfo(Args&&... args)
     {
-        inner_log(Info, std::forward<Args>(args)...);
+        if (compiled(Info))
+            inner_log(Info, std::forward<Args>(args)...);
     }
     /**
      * @brief Logging with warn level
@@ -196,7 +359,8 @@ public:
     template<typename ...Args>
     void logWarn(Args&&... args)
     {
-        inner_log(Warn, std::forward<Args>(args)...);
+        if (compiled(Warn))
+            inner_log(Warn, std::forward<Args>(args)...);
     }
     /**
      * @brief Logging with error level
@@ -206,7 +370,8 @@ public:
     template<typename ...Args>
     void logError(Args&&... args)
     {
-        inner_log(Error, std::forward<Args>(args)...);
+        if (compiled(Error))
+            inner_log(Error, std::forward<Args>(args)...);
     }
 private:
     /**
@@ -215,9 +380,9 @@ private:
      * @tparam T argument type
      */
     template<typename T>
-    void unpack(T t)
+    static void unpack(std::ostream& out, T t)
     {
-        buffer_unpack_ << t;
+        write_arg(out, t, 0);
     }
     /**
      * @brief unpacks variadic template arguments sequence
@@ -225,17 +390,246 @@ private:
      * @tparam Args other arguments types
      */
     template<typename T, typename ...Args>
-    void unpack(T t, Args&&... args)
+    static void unpack(std::ostream& out, T t, Args&&... args)
+    {
+        write_arg(out, t, 0);
+        unpack(out, std::forward<Args>(args)...);
+    }
+    /**
+     * @brief Writes result of a callable argument, so expensive
+     * payloads are built only for messages, that are written
+     */
+    template<typename T>
+    static auto write_arg(std::ostream& out, T& t, int) -> decltype(out << t(), void())
+    {
+        out << t();
+    }
+    /**
+     * @brief Writes plain argument
+     */
+    template<typename T>
+    static void write_arg(std::ostream& out, T& t, long)
+    {
+        out << t;
+    }
+    /**
+     * @brief Argument types of the binary log
+     */
+    enum ArgType : unsigned char
+    {
+        ///@{
+        ArgText = 0,    ///< length and bytes
+        ArgLiteral,     ///< id of a string literal
+        ArgSigned,      ///< zigzag varint
+        ArgUnsigned,    ///< varint
+        ArgDouble,      ///< 8 bytes
+        ArgBool,        ///< 1 byte
+        ArgChar,        ///< 1 byte
+        ArgSpaces       ///< varint number of spaces, e.g. padding of tree dumps
+        ///@}
+    };
+    /**
+     * @brief Binary encoding of an argument type
+     */
+    template<typename T>
+    struct Encoding : std::integral_constant<int,
+        std::is_array<T>::value && std::is_same<typename std::remove_cv<typename std::remove_extent<T>::type>::type, char>::value ? ArgLiteral :
+        std::is_same<T, bool>::value ? ArgBool :
+        std::is_same<T, char>::value || std::is_same<T, signed char>::value ||
+        std::is_same<T, unsigned char>::value ? ArgChar :
+        std::is_integral<T>::value && std::is_signed<T>::value ? ArgSigned :
+        std::is_integral<T>::value || std::is_enum<T>::value ? ArgUnsigned :
+        std::is_floating_point<T>::value ? ArgDouble : ArgText>
+    { };
+    /**
+     * @brief Append varint to binary buffer
+     */
+    static void encode_varint(std::string& out, uint64_t value)
     {
-        buffer_unpack_ << t;
-        unpack(std::forward<Args>(args)...);
+        while (value >= 0x80)
+        {
+            out += static_cast<char>(value | 0x80);
+            value >>= 7;
+        }
+        out += static_cast<char>(value);
     }
+    /**
+     * @brief Append text argument to binary buffer, long runs of spaces are counted
+     */
+    static void encode_text(std::string& out, const char* text, size_t size)
+    {
+        const size_t min_run = 8;
+        const char* end = text + size;
+        while (text != end)
+        {
+            const char* run = text;
+            size_t spaces = 0;
+            for (; run != end; ++run)
+            {
+                spaces = *run == ' ' ? spaces + 1 : 0;
+                if (spaces == min_run)
+                    break;
+            }
+            const char* chunk_end = run == end ? end : run + 1 - min_run;
+            if (chunk_end != text)
+            {
+                out += static_cast<char>(ArgText);
+                encode_varint(out, chunk_end - text);
+                out.append(text, chunk_end);
+            }
+            text = chunk_end;
+            if (run != end)
+            {
+                while (run != end && *run == ' ')
+                    ++run;
+                out += static_cast<char>(ArgSpaces);
+                encode_varint(out, run - text);
+                text = run;
+            }
+        }
+    }
+    /**
+     * @brief Encode all arguments of a message
+     */
+    template<typename ...Args>
+    void encode(std::string& out, Args&&... args)
+    {
+        int expand[] = { 0, (encode_arg(out, args, 0), 0)... };
+        (void)expand;
+    }
+    /**
+     * @brief Encodes result of a callable argument
+     */
+    template<typename T>
+    auto encode_arg(std::string& out, T& t, int) -> decltype(t(), void())
+    {
+        auto value = t();
+        encode_arg(out, value, 0);
+    }
+    /**
+     * @brief Encodes plain argument
+     */
+    template<typename T>
+    void encode_arg(std::string& out, T& t, long)
+    {
+        encode_value(out, t, std::integral_constant<int, Encoding<typename std::remove_cv<T>::type>::value>());
+    }
+    template<typename T>
+    void encode_value(std::string& out, const T& t, std::integral_constant<int, ArgLiteral>)
+    {
+        size_t size = std::strlen(t);
+        uint32_t id = 0;
+        if (!literal_id(t, size, id))
+            return encode_text(out, t, size);
+        out += static_cast<char>(ArgLiteral);
+        encode_varint(out, id);
+    }
+    template<typename T>
+    static void encode_value(std::string& out, const T& t, std::integral_constant<int, ArgBool>)
+    {
+        out += static_cast<char>(ArgBool);
+        out += static_cast<char>(t);
+    }
+    template<typename T>
+    static void encode_value(std::string& out, const T& t, std::integral_constant<int, ArgChar>)
+    {
+        out += static_cast<char>(ArgChar);
+        out += t;
+    }
+    template<typename T>
+    static void encode_value(std::string& out, const T& t, std::integral_constant<int, ArgSigned>)
+    {
+        int64_t value = t;
+        out += static_cast<char>(ArgSigned);
+        encode_varint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+    }
+    template<typename T>
+    static void encode_value(std::string& out, const T& t, std::integral_constant<int, ArgUnsigned>)
+    {
+        out += static_cast<char>(ArgUnsigned);
+        encode_varint(out, static_cast<uint64_t>(t));
+    }
+    template<typename T>
+    static void encode_value(std::string& out, const T& t, std::integral_constant<int, ArgDouble>)
+    {
+        double value = t;
+        out += static_cast<char>(ArgDouble);
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    static void encode_value(std::string& out, const std::string& t, std::integral_constant<int, ArgText>)
+    {
+        encode_text(out, t.data(), t.size());
+    }
+    static void encode_value(std::string& out, const char* t, std::integral_constant<int, ArgText>)
+    {
+        encode_text(out, t, std::strlen(t));
+    }
+    template<typename T>
+    static void encode_value(std::string& out, const T& t, std::integral_constant<int, ArgText>)
+    {
+        std::ostringstream text;
+        text << t;
+        encode_value(out, text.str(), std::integral_constant<int, ArgText>());
+    }
+    /**
+     * @brief Id of a string literal in the binary log
+     * @param[in] text literal
+     * @param[in] size literal length
+     * @param[out] id literal id, the literal is defined in the log on first use
+     * @return false if the pointer is known with other text (not a literal)
+     */
+    bool literal_id(const char* text, size_t size, uint32_t& id);
+    /**
+     * @brief Pass binary log frame to the file or the writer thread
+     * @param[in,out] frame encoded frame, may be moved out
+     * @param[in] force ignore overflow policy
+     */
+    void post_binary(std::string& frame, bool force);
+    /**
+     * @brief Write message line to the text log file and rotate it if it is full
+     * @note Requires write_lock_
+     */
+    void write_file_line(Level level, int64_t time, const std::string& message);
+    /**
+     * @brief Rename log file generations and start an empty log file
+     * @note Requires write_lock_; if the log file can't be renamed,
+     * writing goes on at its end and the next attempt is made after
+     * another max_log_file_size_ bytes
+     */
+    void rotate_log();
     /**
      * @brief Write constructed message to file or stdout/stderr
      * @param[in] level log level
+     * @param[in] time time of the log call
      * @param[in] message message to write
      */
-    void write_log_message(Level level, std::string& message);
+    void write_log_message(Level level, int64_t time, const std::string& message);
+    /**
+     * @brief Record message and write it or pass it to the writer thread
+     * @param[in] level log level
+     * @param[in,out] message constructed message, may be moved out
+     */
+    void post(Level level, std::string& message);
+    /**
+     * @brief Temp buffer of the calling thread for variadic template arguments unpacking
+     */
+    static std::ostringstream& unpack_buffer();
+    /**
+     * @brief Temp buffer of the calling thread for binary encoding
+     */
+    static std::string& encode_buffer();
+    /**
+     * @brief Recording state of a thread
+     */
+    struct Recording
+    {
+        bool enabled = false;       ///< @brief recording toggle
+        std::ostringstream buffer;  ///< @brief recorded log messages
+    };
+    /**
+     * @brief Recording state of the calling thread
+     */
+    static Recording& recording();
     /**
      * @brief Inner logging method to perform console/file output
      * @param[in] args arguments for logging
@@ -244,14 +638,82 @@ private:
     template<typename ...Args>
     void inner_log(Level level, Args&&... args)
     {
-        write_lock_.lock();
-        unpack(std::forward<Args>(args)...); // unpack arguments and build message
-        std::string message = buffer_unpack_.str();
-        message.shrink_to_fit();
-        buffer_unpack_.str(std::string());	 // clear message buffer
-        write_log_message(level, message);
-        write_lock_.unlock();
+        if (!enabled(level))
+            return;     // no locking and formatting for filtered messages
+        if (binary_.load(std::memory_order_relaxed) && (output_ == File || output_ == Both) && level >= min_level_file_)
+        {
+            std::string& frame = encode_buffer();
+            frame.clear();
+            begin_frame(frame, level, now());
+            encode(frame, args...);
+            post_binary(frame, false);
+            if (!((output_ == Console || output_ == Both || recorders_.load(std::memory_order_relaxed)) &&
+                  level >= min_level_console_) && !flight_size_.load(std::memory_order_relaxed))
+                return;     // text is not needed
+        }
+        std::ostringstream& buffer = unpack_buffer();
+        unpack(buffer, std::forward<Args>(args)...); // unpack arguments and build message
+        std::string message = buffer.str();
+        buffer.str(std::string());	 // clear message buffer
+        post(level, message);
     }
+    /**
+     * @brief Queued message of the asynchronous mode
+     */
+    struct Record
+    {
+        std::atomic<size_t> sequence;               ///< @brief queue position, the slot is ready for
+        Level level;                                ///< @brief log level
+        int64_t time;                               ///< @brief time of the log call
+        std::string message;                        ///< @brief constructed message or binary frame
+        bool binary;                                ///< @brief message is a binary log frame
+    };
+    /**
+     * @brief Put message into the queue of the asynchronous mode
+     * @return false if the message is discarded
+     */
+    bool enqueue(Level level, int64_t time, std::string& message, bool binary = false, bool force = false);
+    /**
+     * @brief Start binary log frame of a message: kind, level, time and payload placeholder
+     */
+    void begin_frame(std::string& frame, Level level, int64_t time) const;
+    /**
+     * @brief Recent message of a thread
+     */
+    struct FlightEntry
+    {
+        Level level;            ///< @brief log level
+        int64_t time;           ///< @brief time of the log call
+        std::string message;    ///< @brief constructed message
+    };
+    /**
+     * @brief Recent messages of a thread
+     */
+    struct FlightRing
+    {
+        std::mutex lock;                    ///< @brief guards entries against dumps from other threads
+        std::vector<FlightEntry> entries;   ///< @brief ring of messages
+        size_t next = 0;                    ///< @brief position of the next message
+        size_t count = 0;                   ///< @brief number of kept messages
+    };
+    /**
+     * @brief Ring of the calling thread, registered for dumps
+     */
+    FlightRing& flight_ring();
+    /**
+     * @brief Write kept messages of a ring, that are below the level of the log target
+     * @note Requires write_lock_ and ring lock
+     */
+    void write_flight(FlightRing& ring, const char* reason);
+    /**
+     * @brief Write queued messages to sinks
+     * @return number of written messages
+     */
+    size_t write_queued();
+    /**
+     * @brief Background thread of the asynchronous mode
+     */
+    void writer_loop();
 private:
     /**
      * @brief Get string name from Level
@@ -259,13 +721,7 @@ private:
      * @return lvl string name
      * @see Level
      */
-    static std::string level_name(Level lvl);
-    /**
-     * @brief Copy file from one location to another
-     * @param[in] from source
-     * @param[in] to destination
-     */
-    static void copy_file(const std::string &from, const std::string &to);
+    static const std::string& level_name(Level lvl);
     /**
      * @brief Get file size
      * @brief filename file name
@@ -273,24 +729,41 @@ private:
      */
     static std::ifstream::pos_type file_size(const std::string& filename);
     /**
-     * @brief Checks whether file exists
-     * @param[in] filename file name
+     * @brief System locale of the log file, created once
      */
-    static bool exists(const std::string& filename);
+    static const std::locale& system_locale();
     /**
-     * @brief Current time as string
+     * @brief Current wall clock time as string
      */
     static std::string current_time();
+    /**
+     * @brief Format wall clock time like `ctime` does, without the line break
+     * @param[in] time nanoseconds since epoch
+     * @param[in] digits number of digits of second fractions: 0, 3, 6 or 9
+     * @param[out] buffer receives zero terminated text
+     * @param[in] size buffer size
+     */
+    static void format_time(int64_t time, int digits, char* buffer, size_t size);
+    /**
+     * @brief Time for log calls in nanoseconds, since epoch or
+     * since logger start for monotonic timestamps
+     */
+    int64_t now() const;
+    /**
+     * @brief Timestamp text, that is formatted at most once per tick
+     * @param[in] time time of the log call
+     * @note Requires write_lock_
+     */
+    const char* timestamp(int64_t time);
     /**
      * @brief Remove leading and trailing spaces
      * @brief[in,out] s string to trim
      */
     static void trim(std::string& s);
     /**
-     * @brief Get path basename
-     * @param[in] pathname path
+     * @brief Recalculate min_level_ after output settings change
      */
-    static std::string basename(const std::string& pathname);
+    void update_min_level();
 private:
     // Options
     Level min_level_console_;			///< @brief console min log level
@@ -300,13 +773,46 @@ private:
     bool trim_messages_;                ///< @brief remove whitespaces
     std::string log_file_;				///< @brief log file name
     size_t max_log_file_size_;          ///< @brief max log file size
+    size_t max_log_files_;              ///< @brief number of rotated log files to keep
     std::string separator_;             ///< @brief symbol to separate level from message, e.g. `:` or `>`
+    std::atomic<bool> monotonic_;       ///< @brief timestamps are seconds since start_
+    std::chrono::nanoseconds tick_;     ///< @brief wall clock timestamp refresh interval
+    const std::chrono::steady_clock::time_point start_;   ///< @brief origin of monotonic timestamps
+    // Timestamp cache
+    int64_t stamp_slot_;                ///< @brief tick of the cached timestamp
+    char stamp_[48];                    ///< @brief cached timestamp text
+    // Binary log
+    std::ofstream bout_;                ///< @brief binary log output stream
+    std::atomic<bool> binary_;          ///< @brief file target messages go to bout_
+    std::atomic<unsigned int> binary_generation_;   ///< @brief incremented for every binary log file
+    std::mutex literals_lock_;          ///< @brief mutex for literals_
+    // Flight recorder
+    std::atomic<size_t> flight_size_;   ///< @brief ring size per thread, 0 - disabled
+    std::mutex flight_lock_;            ///< @brief mutex for flight_rings_
+    std::vector<std::shared_ptr<FlightRing>> flight_rings_;   ///< @brief rings of running threads
+    std::unordered_map<const char*, std::pair<uint32_t, std::string>> literals_;  ///< @brief ids and texts of defined literals
     // Helpers
-    std::stringstream buffer_unpack_;	///< @brief temp buffer for variadic template arguments unpacking
-    std::stringstream buffer_record_;	///< @brief temp buffer for recording log messages into a string
-    bool record_enabled_;				///< @brief recording toggle
+    std::atomic<unsigned int> recorders_;   ///< @brief number of recording threads
+    std::mutex level_lock_;             ///< @brief serializes min_level_ updates
     std::ofstream fout_;				///< @brief log file output stream
+    size_t log_size_;                   ///< @brief log file size in bytes
     std::mutex write_lock_;             ///< @brief mutex for logging
+    std::atomic<unsigned int> min_level_;   ///< @brief the lowest level, that reaches any output
+    // Asynchronous mode
+    std::unique_ptr<Record[]> ring_;    ///< @brief queue of messages (bounded MPSC ring)
+    size_t ring_mask_;                  ///< @brief queue size - 1
+    std::atomic<size_t> ring_head_;     ///< @brief next position to fill
+    size_t ring_tail_;                  ///< @brief next position to write, owned by the writer
+    std::atomic<size_t> written_;       ///< @brief positions, that are written to sinks
+    std::atomic<uint64_t> dropped_;     ///< @brief discarded messages
+    uint64_t reported_;                 ///< @brief discarded messages, that are logged by the writer
+    Overflow overflow_;                 ///< @brief full queue policy
+    std::atomic<bool> async_;           ///< @brief asynchronous mode toggle
+    std::atomic<bool> stopping_;        ///< @brief writer should exit once the queue is empty
+    std::atomic<bool> writer_idle_;     ///< @brief writer waits for messages
+    std::mutex wake_lock_;              ///< @brief mutex for wake_
+    std::condition_variable wake_;      ///< @brief wakes the idle writer
+    std::thread writer_;                ///< @brief writer thread
 };
 
 #endif  // __glogger_hpp__
@@ -316,6 +822,10 @@ private:
 #include <algorithm>	// std::find_if
 #include <functional>	// std::ptr_fun<int, int>
 #include <cctype>		// std::isspace
+#include <cstdio>		// std::snprintf, std::rename, std::remove
+#include <cerrno>
+#include <iterator>
+#include <vector>
 
 GLogger& GLogger::instance()
 {
@@ -332,24 +842,115 @@ min_level_console_(Level::Info)
 , skip_empty_msgs_(false)
 , trim_messages_(false)
 , max_log_file_size_(2000000) // 2 Mb
+, max_log_files_(5)
 , separator_(": ")
-, record_enabled_(false)
-{ }
+, monotonic_(false)
+, tick_(std::chrono::seconds(1))
+, start_(std::chrono::steady_clock::now())
+, stamp_slot_(-1)
+, binary_(false)
+, binary_generation_(0)
+, flight_size_(0)
+, recorders_(0)
+, log_size_(0)
+, ring_mask_(0)
+, ring_head_(0)
+, ring_tail_(0)
+, written_(0)
+, dropped_(0)
+, reported_(0)
+, overflow_(Block)
+, async_(false)
+, stopping_(false)
+, writer_idle_(false)
+{
+    update_min_level();
+}
+
+GLogger::~GLogger()
+{
+    stop_async();
+}
+
+std::ostringstream& GLogger::unpack_buffer()
+{
+    thread_local std::ostringstream buffer;
+    return buffer;
+}
+
+GLogger::Recording& GLogger::recording()
+{
+    thread_local Recording state;
+    return state;
+}
 
-void GLogger::write_log_message(Level level, std::string& message)
+std::string& GLogger::encode_buffer()
+{
+    thread_local std::string buffer;
+    return buffer;
+}
+
+void GLogger::post(Level level, std::string& message)
 {
     if(trim_messages_)
         trim(message);
-    
+    int64_t time = now();
+    size_t flight_size = flight_size_.load(std::memory_order_relaxed);
+    if (flight_size)
+    {
+        FlightRing& ring = flight_ring();
+        std::lock_guard<std::mutex> ring_lock(ring.lock);
+        if (level >= Error && level != None && ring.count)
+        {
+            // context of the error goes to the file before the error itself
+            flush();
+            std::lock_guard<std::mutex> lock(write_lock_);
+            write_flight(ring, "error");
+        }
+        if (ring.entries.size() != flight_size)
+        {
+            ring.entries.assign(flight_size, FlightEntry());
+            ring.next = ring.count = 0;
+        }
+        FlightEntry& entry = ring.entries[ring.next];
+        entry.level = level;
+        entry.time = time;
+        entry.message.assign(message);  // keeps the capacity of the slot
+        ring.next = (ring.next + 1) % flight_size;
+        ring.count = std::min(ring.count + 1, flight_size);
+        if (level < min_level_console_ && level < min_level_file_ && !recorders_.load(std::memory_order_relaxed))
+            return;     // kept in memory only
+    }
+    // recording
+    if (recorders_.load(std::memory_order_relaxed) && level >= min_level_console_)
+    {
+        Recording& state = recording();
+        if (state.enabled)
+            state.buffer << message << '\n';
+    }
+    if (output_ == Off)
+        return;
+    if (async_.load(std::memory_order_acquire))
+    {
+        enqueue(level, time, message);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(write_lock_);
+    write_log_message(level, time, message);
+}
+
+void GLogger::write_log_message(Level level, int64_t time, const std::string& message)
+{
     if (output_ != Off && !(skip_empty_msgs_ && message.empty()) )
     {
-        std::string snow = current_time();
         // write to log file
         if ((output_ == File || output_ == Both) && level >= min_level_file_)
         {
-            if (fout_.good())
+            if (!binary_ && fout_.good())
             {
-                fout_ << level_name(level) << separator_ << "[" << snow << "]" << separator_ << message << std::endl;
+                write_file_line(level, time, message);
+                if (level == Level::Error)
+                    fout_.flush();
             }
         }
         // write to console
@@ -361,13 +962,172 @@ void GLogger::write_log_message(Level level, std::string& message)
             }
             else
             {
-                std::cout << level_name(level) << separator_ << message << std::endl;
+                std::cout << level_name(level) << separator_ << message << '\n';
             }
         }
     }
-    // recording
-    if (record_enabled_ && level >= min_level_console_)
-        buffer_record_ << message << std::endl;
+}
+
+//-----------------------------------------------------------------------------------------
+// asynchronous mode
+//-----------------------------------------------------------------------------------------
+
+void GLogger::start_async(size_t capacity, Overflow policy)
+{
+    stop_async();
+    size_t size = 2;
+    while (size < capacity)
+        size <<= 1;
+    ring_.reset(new Record[size]);
+    for (size_t i = 0; i < size; ++i)
+        ring_[i].sequence.store(i, std::memory_order_relaxed);
+    ring_mask_ = size - 1;
+    ring_head_.store(0, std::memory_order_relaxed);
+    ring_tail_ = 0;
+    written_.store(0, std::memory_order_relaxed);
+    dropped_.store(0, std::memory_order_relaxed);
+    reported_ = 0;
+    overflow_ = policy;
+    stopping_.store(false, std::memory_order_relaxed);
+    writer_ = std::thread(&GLogger::writer_loop, this);
+    async_.store(true, std::memory_order_release);
+}
+
+void GLogger::stop_async()
+{
+    if (!async_.exchange(false))
+        return;
+    stopping_.store(true, std::memory_order_release);
+    wake_.notify_one();
+    writer_.join();
+}
+
+void GLogger::flush()
+{
+    if (!async_.load(std::memory_order_acquire))
+    {
+        std::lock_guard<std::mutex> lock(write_lock_);
+        if (fout_.is_open())
+            fout_.flush();
+        if (bout_.is_open())
+            bout_.flush();
+        std::cout.flush();
+        return;
+    }
+    size_t target = ring_head_.load(std::memory_order_acquire);
+    while (written_.load(std::memory_order_acquire) < target)
+    {
+        wake_.notify_one();
+        std::this_thread::yield();
+    }
+}
+
+uint64_t GLogger::dropped() const
+{
+    return dropped_.load(std::memory_order_relaxed);
+}
+
+bool GLogger::enqueue(Level level, int64_t time, std::string& message, bool binary, bool force)
+{
+    size_t pos = ring_head_.load(std::memory_order_relaxed);
+    Record* record = nullptr;
+    while (true)
+    {
+        record = &ring_[pos & ring_mask_];
+        size_t sequence = record->sequence.load(std::memory_order_acquire);
+        if (sequence == pos)
+        {
+            // the slot is free, claim the position
+            if (ring_head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (sequence < pos)
+        {
+            // full: the writer did not release the slot of the previous round
+            if (overflow_ != Block && !force)
+            {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            wake_.notify_one();
+            std::this_thread::yield();
+            pos = ring_head_.load(std::memory_order_relaxed);
+        }
+        else
+        {
+            pos = ring_head_.load(std::memory_order_relaxed);
+        }
+    }
+    record->level = level;
+    record->time = time;
+    record->message = std::move(message);
+    record->binary = binary;
+    record->sequence.store(pos + 1, std::memory_order_release);
+    if (writer_idle_.load())
+        wake_.notify_one();
+    return true;
+}
+
+size_t GLogger::write_queued()
+{
+    size_t count = 0;
+    std::lock_guard<std::mutex> lock(write_lock_);
+    // at most one round, so a busy queue does not keep the lock forever
+    while (count <= ring_mask_)
+    {
+        Record& record = ring_[ring_tail_ & ring_mask_];
+        if (record.sequence.load(std::memory_order_acquire) != ring_tail_ + 1)
+            break;
+        if (record.binary)
+            bout_.write(record.message.data(), record.message.size());
+        else
+            write_log_message(record.level, record.time, record.message);
+        record.message.clear();
+        record.sequence.store(ring_tail_ + ring_mask_ + 1, std::memory_order_release);
+        ++ring_tail_;
+        ++count;
+    }
+    uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+    if (overflow_ == Count && dropped != reported_)
+    {
+        std::ostringstream message;
+        message << "[GLogger]: " << dropped - reported_ << " messages dropped";
+        write_log_message(Warn, now(), message.str());
+        reported_ = dropped;
+    }
+    if (count)
+    {
+        // one flush per batch instead of one per message
+        if (fout_.is_open())
+            fout_.flush();
+        if (bout_.is_open())
+            bout_.flush();
+        std::cout.flush();
+        written_.store(ring_tail_, std::memory_order_release);
+    }
+    return count;
+}
+
+void GLogger::writer_loop()
+{
+    while (true)
+    {
+        bool stopping = stopping_.load(std::memory_order_acquire);
+        if (write_queued())
+            continue;
+        if (stopping)
+            break;
+        writer_idle_.store(true);
+        Record& next = ring_[ring_tail_ & ring_mask_];
+        if (next.sequence.load(std::memory_order_acquire) != ring_tail_ + 1 &&
+            !stopping_.load(std::memory_order_acquire))
+        {
+            // the timeout covers a notification, that comes before the wait
+            std::unique_lock<std::mutex> lock(wake_lock_);
+            wake_.wait_for(lock, std::chrono::milliseconds(10));
+        }
+        writer_idle_.store(false);
+    }
 }
 
 //-----------------------------------------------------------------------------------------
@@ -377,6 +1137,7 @@ void GLogger::write_log_message(Level level, std::string& message)
 void GLogger::set_output_mode(Output mode)
 {
     output_ = mode;
+    update_min_level();
 }
 
 void GLogger::set_min_level(Output target, Level level)
@@ -397,11 +1158,24 @@ void GLogger::set_min_level(Output target, Level level)
             std::cerr << "[GLogger Error]: invalid target" << std::endl;
             break;
     }
+    update_min_level();
+}
+
+void GLogger::update_min_level()
+{
+    std::lock_guard<std::mutex> lock(level_lock_);
+    unsigned int level = Level::None + 1;   // nothing is written
+    if (flight_size_.load())
+        level = Trace;      // everything is kept in memory
+    if (output_ == Console || output_ == Both || recorders_.load())
+        level = std::min<unsigned int>(level, min_level_console_);
+    if (output_ == File || output_ == Both)
+        level = std::min<unsigned int>(level, min_level_file_);
+    min_level_.store(level, std::memory_order_relaxed);
 }
 
 void GLogger::set_log_filename(const std::string& filename)
 {
-    static std::locale sysLoc("");	// get system locale
     log_file_ = filename;
     
     if (!log_file_.empty())
@@ -409,26 +1183,30 @@ void GLogger::set_log_filename(const std::string& filename)
         std::string snow = current_time();
         if (output_ == File || output_ == Both)
         {
-            if (exists(log_file_) && file_size(log_file_) > max_log_file_size_)
-            {
-                std::string bname = basename(log_file_);
-                copy_file(log_file_, snow + "_" + bname);
-                fout_.open(log_file_, std::ios::out);
-            }
-            else
+            bool opened = false;
             {
+                std::lock_guard<std::mutex> lock(write_lock_);
+                if (fout_.is_open())
+                    fout_.close();  // switch to the new file
                 fout_.open(log_file_, std::ios::out | std::ios::app);
+                log_size_ = fout_.good() ? static_cast<size_t>(file_size(log_file_)) : 0;
+                if (max_log_file_size_ && log_size_ > max_log_file_size_)
+                    rotate_log();
+                opened = fout_.good();
+                if (opened)
+                {
+                    fout_.imbue(system_locale());
+                    std::ostringstream header;
+                    header << '\n'
+                    << "----------------------------------------------------------------" << '\n'
+                    << "--------------------" << snow << "--------------------" << '\n'
+                    << "----------------------------------------------------------------"
+                    << '\n' << '\n';
+                    fout_ << header.str();
+                    log_size_ += header.str().size();
+                }
             }
-            if (fout_.good())
-            {
-                fout_.imbue(sysLoc);
-                fout_ << std::endl
-                << "----------------------------------------------------------------" << std::endl
-                << "--------------------" << snow << "--------------------" << std::endl
-                << "----------------------------------------------------------------"
-                << std::endl << std::endl;
-            }
-            else
+            if (!opened)
             {
                 GLogger::instance().logError("failed to open log file");
             }
@@ -441,6 +1219,50 @@ void GLogger::set_max_log_file_size(size_t size)
     max_log_file_size_ = size;
 }
 
+void GLogger::set_max_log_files(size_t count)
+{
+    max_log_files_ = count;
+}
+
+void GLogger::write_file_line(Level level, int64_t time, const std::string& message)
+{
+    const std::string& name = level_name(level);
+    const char* stamp = timestamp(time);
+    fout_ << name << separator_ << "[" << stamp << "]" << separator_ << message << '\n';
+    log_size_ += name.size() + 2 * separator_.size() + std::strlen(stamp) + message.size() + 3;
+    if (max_log_file_size_ && log_size_ > max_log_file_size_)
+        rotate_log();
+}
+
+void GLogger::rotate_log()
+{
+    fout_.close();
+    // renaming is O(1) regardless of the file size; the target is removed
+    // first, because rename does not replace files on every platform
+    bool moved = true;
+    int error = 0;
+    for (size_t i = max_log_files_; i > 0 && moved; --i)
+    {
+        std::string to = log_file_ + "." + std::to_string(i);
+        std::string from = i > 1 ? log_file_ + "." + std::to_string(i - 1) : log_file_;
+        if (std::remove(to.c_str()) != 0 && errno != ENOENT)
+            moved = false;
+        else if (std::rename(from.c_str(), to.c_str()) != 0 && (errno != ENOENT || i == 1))
+            moved = false;  // older generations may be missing, the log file may not
+        error = errno;
+    }
+    // nothing is lost, if the log file stays in place
+    fout_.open(log_file_, std::ios::out | (moved ? std::ios::trunc : std::ios::app));
+    fout_.imbue(system_locale());
+    log_size_ = 0;
+    if (!moved && fout_.good())
+    {
+        // not through write_file_line, that may rotate again
+        fout_ << level_name(Warn) << separator_ << "[" << timestamp(now()) << "]" << separator_
+              << "log rotation failed: " << std::strerror(error) << '\n';
+    }
+}
+
 void GLogger::set_skip_empty_messages(bool flag)
 {
     skip_empty_msgs_ = flag;
@@ -456,15 +1278,374 @@ void GLogger::set_separator(const std::string& separator)
     separator_ = separator;
 }
 
+void GLogger::set_timestamp_tick(std::chrono::nanoseconds tick)
+{
+    std::lock_guard<std::mutex> lock(write_lock_);
+    tick_ = std::max(tick, std::chrono::nanoseconds(1));
+    stamp_slot_ = -1;
+}
+
+void GLogger::set_monotonic_timestamps(bool flag)
+{
+    monotonic_ = flag;
+}
+
+//-----------------------------------------------------------------------------------------
+// timestamps
+//-----------------------------------------------------------------------------------------
+
+int64_t GLogger::now() const
+{
+    if (monotonic_.load(std::memory_order_relaxed))
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+const char* GLogger::timestamp(int64_t time)
+{
+    if (monotonic_.load(std::memory_order_relaxed))
+    {
+        // plain integer formatting, nothing to cache
+        std::snprintf(stamp_, sizeof(stamp_), "%lld.%09lld",
+                      static_cast<long long>(time / 1000000000), static_cast<long long>(time % 1000000000));
+        stamp_slot_ = -1;
+        return stamp_;
+    }
+    int64_t slot = time / tick_.count();
+    if (slot != stamp_slot_)
+    {
+        int digits = tick_ >= std::chrono::seconds(1) ? 0 :
+                     tick_ >= std::chrono::milliseconds(1) ? 3 :
+                     tick_ >= std::chrono::microseconds(1) ? 6 : 9;
+        format_time(slot * tick_.count(), digits, stamp_, sizeof(stamp_));
+        stamp_slot_ = slot;
+    }
+    return stamp_;
+}
+
+//-----------------------------------------------------------------------------------------
+// flight recorder
+//-----------------------------------------------------------------------------------------
+
+void GLogger::set_flight_recorder(size_t records)
+{
+    flight_size_ = records;
+    update_min_level();
+}
+
+GLogger::FlightRing& GLogger::flight_ring()
+{
+    /**
+     * @brief Registers the ring of a thread while the thread runs
+     */
+    struct Holder
+    {
+        std::shared_ptr<FlightRing> ring = std::make_shared<FlightRing>();
+        Holder()
+        {
+            GLogger& logger = GLogger::instance();
+            std::lock_guard<std::mutex> lock(logger.flight_lock_);
+            logger.flight_rings_.push_back(ring);
+        }
+        ~Holder()
+        {
+            GLogger& logger = GLogger::instance();
+            std::lock_guard<std::mutex> lock(logger.flight_lock_);
+            auto& rings = logger.flight_rings_;
+            rings.erase(std::remove(rings.begin(), rings.end(), ring), rings.end());
+        }
+    };
+    thread_local Holder holder;
+    return *holder.ring;
+}
+
+void GLogger::write_flight(FlightRing& ring, const char* reason)
+{
+    // messages, that the target got already, are not repeated
+    const bool to_file = binary_ ? bout_.is_open() : fout_.is_open();
+    const bool written = to_file ? (output_ == File || output_ == Both) : (output_ == Console || output_ == Both);
+    const Level min_level = to_file ? min_level_file_ : min_level_console_;
+    size_t size = ring.entries.size();
+    std::vector<const FlightEntry*> entries;
+    entries.reserve(ring.count + 2);
+    for (size_t i = size - ring.count; i < size; ++i)
+    {
+        const FlightEntry& entry = ring.entries[(ring.next + i) % size];
+        if (!written || entry.level < min_level)
+            entries.push_back(&entry);
+    }
+    ring.count = 0;     // written once
+    if (entries.empty())
+        return;
+    std::ostringstream title;
+    title << "flight recorder (" << reason << "): " << entries.size() << " recent messages";
+    FlightEntry begin = { None, now(), title.str() };
+    FlightEntry end = { None, now(), "flight recorder: end" };
+    entries.insert(entries.begin(), &begin);
+    entries.push_back(&end);
+    for (auto entry : entries)
+    {
+        if (binary_ && bout_.is_open())
+        {
+            std::string frame;
+            begin_frame(frame, entry->level, entry->time);
+            encode_text(frame, entry->message.data(), entry->message.size());
+            uint32_t payload = static_cast<uint32_t>(frame.size() - 5);
+            std::memcpy(&frame[1], &payload, sizeof(payload));
+            bout_.write(frame.data(), frame.size());
+        }
+        else
+        {
+            if (fout_.is_open())
+                write_file_line(entry->level, entry->time, entry->message);
+            else
+                std::cerr << level_name(entry->level) << separator_ << "[" << timestamp(entry->time) << "]"
+                          << separator_ << entry->message << '\n';
+        }
+    }
+    if (bout_.is_open())
+        bout_.flush();
+    if (fout_.is_open())
+        fout_.flush();
+}
+
+void GLogger::dump_flight_recorder()
+{
+    std::unique_lock<std::mutex> rings_lock(flight_lock_, std::try_to_lock);
+    std::unique_lock<std::mutex> lock(write_lock_, std::try_to_lock);
+    if (!rings_lock.owns_lock() || !lock.owns_lock())
+        return;
+    for (auto& ring : flight_rings_)
+    {
+        std::unique_lock<std::mutex> ring_lock(ring->lock, std::try_to_lock);
+        if (ring_lock.owns_lock() && ring->count)
+            write_flight(*ring, "dump");
+    }
+}
+
+//-----------------------------------------------------------------------------------------
+// binary log
+//
+// file:    "GLOGBIN1" frame...
+// frame:   kind (0 - message, 1 - literal) uint32(payload size) payload
+// message: level (bit 7 - monotonic time) int64 time argument...
+// literal: varint(id) bytes
+//-----------------------------------------------------------------------------------------
+
+void GLogger::set_binary_log_filename(const std::string& filename)
+{
+    flush();
+    // the same order as in literal_id, that posts definitions
+    std::lock_guard<std::mutex> literals_lock(literals_lock_);
+    std::lock_guard<std::mutex> lock(write_lock_);
+    binary_ = false;
+    if (bout_.is_open())
+        bout_.close();
+    literals_.clear();
+    ++binary_generation_;   // literals are defined again in the new file
+    if (filename.empty())
+        return;
+    bout_.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (bout_.good())
+    {
+        bout_.write("GLOGBIN1", 8);
+        binary_ = true;
+    }
+    else
+    {
+        std::cerr << "[GLogger Error]: failed to open binary log file" << std::endl;
+    }
+}
+
+void GLogger::begin_frame(std::string& frame, Level level, int64_t time) const
+{
+    frame += '\0';
+    frame.append(4, '\0');   // payload size, fixed width so it is patched in place
+    frame += static_cast<char>(level | (monotonic_.load(std::memory_order_relaxed) ? 0x80 : 0));
+    frame.append(reinterpret_cast<const char*>(&time), sizeof(time));
+}
+
+void GLogger::post_binary(std::string& frame, bool force)
+{
+    uint32_t size = static_cast<uint32_t>(frame.size() - 5);
+    std::memcpy(&frame[1], &size, sizeof(size));
+    if (async_.load(std::memory_order_acquire))
+    {
+        enqueue(None, 0, frame, true, force);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(write_lock_);
+    if (bout_.is_open())
+        bout_.write(frame.data(), frame.size());
+}
+
+bool GLogger::literal_id(const char* text, size_t size, uint32_t& id)
+{
+    /**
+     * @brief Literals known to the calling thread
+     */
+    struct Cache
+    {
+        unsigned int generation = 0;
+        std::unordered_map<const char*, std::pair<uint32_t, const std::string*>> ids;
+    };
+    thread_local Cache cache;
+    unsigned int generation = binary_generation_.load(std::memory_order_acquire);
+    if (cache.generation != generation)
+    {
+        cache.ids.clear();
+        cache.generation = generation;
+    }
+    auto it = cache.ids.find(text);
+    if (it == cache.ids.end())
+    {
+        std::lock_guard<std::mutex> lock(literals_lock_);
+        auto defined = literals_.find(text);
+        if (defined == literals_.end())
+        {
+            // ids are assigned in definition order; the definition is posted
+            // under the lock, so it precedes every use by any thread
+            uint32_t next = static_cast<uint32_t>(literals_.size());
+            defined = literals_.emplace(text, std::make_pair(next, std::string(text, size))).first;
+            std::string frame(1, '\1');
+            frame.append(4, '\0');
+            encode_varint(frame, next);
+            frame.append(text, size);
+            post_binary(frame, true);
+        }
+        it = cache.ids.emplace(text, std::make_pair(defined->second.first, &defined->second.second)).first;
+    }
+    const std::string& known = *it->second.second;
+    if (known.size() != size || std::memcmp(known.data(), text, size))
+        return false;   // reused buffer, not a literal
+    id = it->second.first;
+    return true;
+}
+
+bool GLogger::decode_binary(std::istream& in, std::ostream& out)
+{
+    char magic[8];
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, "GLOGBIN1", sizeof(magic)))
+        return false;
+    std::vector<std::string> literals;
+    std::string payload;
+    char kind;
+    while (in.get(kind))
+    {
+        uint32_t size = 0;
+        if (!in.read(reinterpret_cast<char*>(&size), sizeof(size)))
+            return false;
+        payload.resize(size);
+        if (size && !in.read(&payload[0], size))
+            return false;
+        const char* p = payload.data();
+        const char* end = p + payload.size();
+        auto varint = [&](uint64_t& value) {
+            value = 0;
+            for (int shift = 0; p != end && shift < 64; shift += 7)
+            {
+                unsigned char byte = static_cast<unsigned char>(*p++);
+                value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+                if (!(byte & 0x80))
+                    return true;
+            }
+            return false;
+        };
+        uint64_t value = 0;
+        if (kind == 1)
+        {
+            if (!varint(value) || value != literals.size())
+                return false;
+            literals.emplace_back(p, end);
+            continue;
+        }
+        if (kind != 0 || end - p < 9)
+            return false;
+        unsigned char level = static_cast<unsigned char>(*p++);
+        int64_t time = 0;
+        std::memcpy(&time, p, sizeof(time));
+        p += sizeof(time);
+        char stamp[48];
+        if (level & 0x80)
+            std::snprintf(stamp, sizeof(stamp), "%lld.%09lld",
+                          static_cast<long long>(time / 1000000000), static_cast<long long>(time % 1000000000));
+        else
+            format_time(time, 6, stamp, sizeof(stamp));
+        level &= 0x7F;
+        if (level > None)
+            return false;
+        out << level_name(static_cast<Level>(level)) << ": [" << stamp << "]: ";
+        while (p != end)
+        {
+            switch (static_cast<unsigned char>(*p++))
+            {
+                case ArgText:
+                    if (!varint(value) || value > static_cast<uint64_t>(end - p))
+                        return false;
+                    out.write(p, value);
+                    p += value;
+                    break;
+                case ArgLiteral:
+                    if (!varint(value) || value >= literals.size())
+                        return false;
+                    out << literals[value];
+                    break;
+                case ArgSigned:
+                    if (!varint(value))
+                        return false;
+                    out << static_cast<int64_t>((value >> 1) ^ (~(value & 1) + 1));
+                    break;
+                case ArgUnsigned:
+                    if (!varint(value))
+                        return false;
+                    out << value;
+                    break;
+                case ArgDouble:
+                {
+                    double number = 0;
+                    if (end - p < static_cast<ptrdiff_t>(sizeof(number)))
+                        return false;
+                    std::memcpy(&number, p, sizeof(number));
+                    p += sizeof(number);
+                    out << number;
+                    break;
+                }
+                case ArgBool:
+                    if (p == end)
+                        return false;
+                    out << static_cast<bool>(*p++);
+                    break;
+                case ArgChar:
+                    if (p == end)
+                        return false;
+                    out << *p++;
+                    break;
+                case ArgSpaces:
+                    if (!varint(value))
+                        return false;
+                    std::fill_n(std::ostreambuf_iterator<char>(out), value, ' ');
+                    break;
+                default:
+                    return false;
+            }
+        }
+        out << '\n';
+    }
+    return in.eof();
+}
+
 //-----------------------------------------------------------------------------------------
 // recording
 //-----------------------------------------------------------------------------------------
 
 void GLogger::start_record()
 {
-    if (!record_enabled_)
+    Recording& state = recording();
+    if (!state.enabled)
     {
-        record_enabled_ = true;
+        state.enabled = true;
+        ++recorders_;
+        update_min_level();
     }
     else
     {
@@ -475,11 +1656,14 @@ void GLogger::start_record()
 std::string GLogger::end_record()
 {
     std::string text;
-    if (record_enabled_)
+    Recording& state = recording();
+    if (state.enabled)
     {
-        record_enabled_ = false;
-        text = buffer_record_.str();
-        buffer_record_.str(std::string());
+        state.enabled = false;
+        --recorders_;
+        update_min_level();
+        text = state.buffer.str();
+        state.buffer.str(std::string());
     }
     else
     {
@@ -492,17 +1676,16 @@ std::string GLogger::end_record()
 // static helpers
 //-----------------------------------------------------------------------------------------
 
-std::string GLogger::level_name(Level lvl)
+const std::string& GLogger::level_name(Level lvl)
 {
-    static std::string levels[] {"Trace", "Debug", "Info", "Warn", "Error", ""};
+    static const std::string levels[] {"Trace", "Debug", "Info", "Warn", "Error", ""};
     return levels[lvl];
 }
 
-void GLogger::copy_file(const std::string &from, const std::string &to)
+const std::locale& GLogger::system_locale()
 {
-    std::ifstream is(from, std::ios::in | std::ios::binary);
-    std::ofstream os(to, std::ios::out | std::ios::binary);
-    os << is.rdbuf();
+    static const std::locale locale("");
+    return locale;
 }
 
 std::ifstream::pos_type GLogger::file_size(const std::string& filename)
@@ -511,26 +1694,33 @@ std::ifstream::pos_type GLogger::file_size(const std::string& filename)
     return in.tellg();
 }
 
-bool GLogger::exists(const std::string& name)
+
+std::string GLogger::current_time()
 {
-    std::ifstream f(name);
-    return f.good();
+    char buffer[48];
+    format_time(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count(), 0, buffer, sizeof(buffer));
+    return buffer;
 }
 
-std::string GLogger::current_time()
+void GLogger::format_time(int64_t time, int digits, char* buffer, size_t size)
 {
-    auto now = std::chrono::system_clock::now();
-    auto ttnow = std::chrono::system_clock::to_time_t(now);
+    std::time_t seconds = static_cast<std::time_t>(time / 1000000000);
+    std::tm tm;
 #ifdef _WIN32
-    char cnow[50];
-    ctime_s(cnow, 50, &ttnow);
-    std::string snow(cnow);
+    localtime_s(&tm, &seconds);
 #else
-    std::string snow(ctime(&ttnow));
+    localtime_r(&seconds, &tm);  // unlike ctime, thread-safe
 #endif
-    snow.shrink_to_fit();
-    snow.pop_back();
-    return snow;
+    size_t n = std::strftime(buffer, size, "%a %b %e %H:%M:%S", &tm);
+    if (digits)
+    {
+        long long fraction = time % 1000000000;
+        for (int i = digits; i < 9; ++i)
+            fraction /= 10;
+        n += std::snprintf(buffer + n, size - n, ".%0*lld", digits, fraction);
+    }
+    std::strftime(buffer + n, size - n, " %Y", &tm);
 }
 
 void GLogger::trim(std::string& s) {
@@ -552,15 +1742,4 @@ void GLogger::trim(std::string& s) {
     }
 }
 
-std::string GLogger::basename(const std::string& pathname) {
-    return std::string(std::find_if(pathname.rbegin(), pathname.rend(),
-                                    [](char ch) {
-#ifdef _WIN32
-                                        return ch == '\\';
-#else
-                                        return ch == '/';
-#endif
-                                    }).base(),
-                       pathname.end());
-}
 #endif  // __glogger_implementation__
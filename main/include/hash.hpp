@@ -0,0 +1,44 @@
+/**
+ * @file hash.hpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief Fast non-cryptographic hashing
+ */
+
+#ifndef hash_hpp
+#define hash_hpp
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace hash
+{
+    /**
+     * @brief 64-bit xxHash (XXH64) of a memory block
+     * @param[in] data data to hash
+     * @param[in] size data size in bytes
+     * @param[in] seed hash seed, allows to chain hashes
+     * @return hash value
+     */
+    uint64_t xxh64(const void* data, size_t size, uint64_t seed = 0);
+    /**
+     * @brief 64-bit xxHash (XXH64) of a string
+     */
+    inline uint64_t xxh64(const std::string& s, uint64_t seed = 0)
+    {
+        return xxh64(s.data(), s.size(), seed);
+    }
+    /**
+     * @brief Hash value as 16 hex digits
+     */
+    std::string to_hex(uint64_t value);
+    /**
+     * @brief Parse hash value written by to_hex
+     * @return false if text is not a hash value
+     */
+    bool from_hex(const std::string& text, uint64_t& value);
+}
+
+#endif /* hash_hpp */
@@ -0,0 +1,142 @@
+/**
+ * @file json.hpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief Minimal JSON value for line based protocols
+ */
+
+#ifndef json_hpp
+#define json_hpp
+
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace json
+{
+    /**
+     * @class Value
+     * @brief JSON value: null, boolean, number, string, array or object
+     *
+     * Object members keep insertion order. Strings are UTF-8,
+     * `\uXXXX` escapes are decoded on parse.
+     *
+     * Usage example:
+     * @code{.cpp}
+     *     json::Value request;
+     *     if (json::Value::parse(R"({"id": 1, "formula": "y = x;"})", request))
+     *     {
+     *         json::Value response = json::Value::object();
+     *         response.set("id", request["id"]);
+     *         response.set("latex", "...");
+     *         std::cout << response.dump() << '\n';
+     *     }
+     * @endcode
+     */
+    class Value
+    {
+    public:
+        /**
+         * @brief Value type
+         */
+        enum Type
+        {
+            ///@{
+            Null = 0,
+            Boolean,
+            Number,
+            String,
+            Array,
+            Object
+            ///@}
+        };
+    public:
+        Value();
+        Value(bool value);
+        Value(int value);
+        Value(double value);
+        Value(const char* value);
+        Value(const std::string& value);
+        /**
+         * @brief Empty array
+         */
+        static Value array();
+        /**
+         * @brief Empty object
+         */
+        static Value object();
+        /**
+         * @brief Parse JSON text
+         * @param[in] text JSON text, surrounding whitespaces are allowed
+         * @param[out] value parsed value
+         * @return false if text is not a single valid JSON value
+         */
+        static bool parse(const std::string& text, Value& value);
+    public:
+        Type type() const;
+        bool is_null() const;
+        bool is_number() const;
+        bool is_string() const;
+        bool is_array() const;
+        bool is_object() const;
+        /**
+         * @brief Boolean value, false for other types
+         */
+        bool as_bool() const;
+        /**
+         * @brief Number value, 0 for other types
+         */
+        double as_number() const;
+        /**
+         * @brief String value, empty for other types
+         */
+        const std::string& as_string() const;
+        /**
+         * @brief Array items, empty for other types
+         */
+        const std::vector<Value>& items() const;
+        /**
+         * @brief Append array item
+         */
+        void push(const Value& item);
+        /**
+         * @brief Object member or null value if there is no such member
+         */
+        const Value& operator[](const std::string& key) const;
+        /**
+         * @brief Checks whether object has member
+         */
+        bool has(const std::string& key) const;
+        /**
+         * @brief Set object member, replacing the previous value
+         * @return this value
+         */
+        Value& set(const std::string& key, const Value& value);
+        /**
+         * @brief Compact JSON text, that fits one line
+         */
+        std::string dump() const;
+        /**
+         * @brief Append compact JSON text to out
+         */
+        void dump(std::string& out) const;
+    private:
+        class Parser;
+        Type type_;                                         ///< @brief value type
+        bool bool_;                                         ///< @brief boolean value
+        double number_;                                     ///< @brief number value
+        std::string string_;                                ///< @brief string value
+        std::vector<Value> items_;                          ///< @brief array items
+        std::vector<std::pair<std::string, Value>> members_; ///< @brief object members
+    };
+
+    /**
+     * @brief Append JSON string literal with escaped characters to out
+     * @param[in] text UTF-8 text
+     * @param[out] out receives quoted text
+     */
+    void quote(const std::string& text, std::string& out);
+}
+
+#endif /* json_hpp */
@@ -12,6 +12,8 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <cstdint>
+#include <atomic>
 
 class Lexeme;
 
@@ -53,6 +55,17 @@ public:
      * @param[in] priority base priority
      */
     static void add_lexeme(const std::string& lex, Type type, int priority);
+    /**
+     * @brief Remove lexeme added with add_lexeme
+     * @param[in] lex lexeme as string
+     * @return false if the lexeme is not in the library
+     */
+    static bool remove_lexeme(const std::string& lex);
+    /**
+     * @brief Add lexemes, that are supported by ctex, but not by the base library
+     * @note adds them once, call before translators are created
+     */
+    static void add_extensions();
     /**
      * @brief Get lexemes of selected type
      * @param type lexeme type
@@ -83,6 +96,16 @@ public:
      * @return lexeme's base priority
      */
     static int get_priority(const std::string& lex);
+    /**
+     * @brief Hash of the whole library: lexemes, their types and priorities
+     * @note changes whenever the library is extended
+     */
+    static uint64_t fingerprint();
+    /**
+     * @brief Number of changes of the library
+     * @note cheap to check before every use of cached translations
+     */
+    static uint64_t revision();
 public:
     /**
      * @brief Max priority level
@@ -94,6 +117,10 @@ private:
      * <lexeme, <type , priority>>
      */
     static std::vector<LexData> lex_library;
+    /**
+     * @brief Number of changes of the library
+     */
+    static std::atomic<uint64_t> revision_;
 };
 
 
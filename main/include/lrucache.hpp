@@ -0,0 +1,187 @@
+/**
+ * @file lrucache.hpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief Bounded thread-safe LRU cache
+ */
+
+#ifndef lrucache_hpp
+#define lrucache_hpp
+
+#include <cstdint>
+#include <algorithm>
+#include <string>
+#include <list>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+
+/**
+ * @class LruCache
+ * @brief Bounded LRU cache keyed by 64-bit hash
+ *
+ * Entries are spread over independently locked shards, so concurrent
+ * lookups rarely wait for each other. Each entry keeps the full key text
+ * to tell hash collisions from hits.
+ * @tparam Value cached value type
+ */
+template<typename Value>
+class LruCache
+{
+public:
+    /**
+     * @param[in] capacity max number of entries
+     * @param[in] shards number of independently locked shards
+     */
+    explicit LruCache(size_t capacity, size_t shards = 16) :
+    generation_(0)
+    , hits_(0)
+    , misses_(0)
+    {
+        shards = std::max<size_t>(1, std::min(shards, capacity));
+        for (size_t i = 0; i < shards; ++i)
+        {
+            shards_.emplace_back(new Shard());
+            // the remainder goes to the first shards
+            shards_.back()->capacity = std::max<size_t>(1, capacity / shards + (i < capacity % shards));
+        }
+    }
+    ~LruCache() = default;
+    
+    LruCache(const LruCache&) = delete;
+    LruCache& operator=(const LruCache&) = delete;
+public:
+    /**
+     * @brief Find value and mark it as recently used
+     * @param[in] key hash of text
+     * @param[in] text key text
+     * @param[out] value found value
+     * @return true on hit
+     */
+    bool lookup(uint64_t key, const std::string& text, Value& value)
+    {
+        Shard& shard = shard_for(key);
+        {
+            std::lock_guard<std::mutex> lock(shard.lock);
+            auto it = shard.index.find(key);
+            if (it != shard.index.end() && it->second->text == text)
+            {
+                shard.items.splice(shard.items.begin(), shard.items, it->second);
+                value = it->second->value;
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    /**
+     * @brief Store value, the least recently used entry is evicted when shard is full
+     * @param[in] key hash of text
+     * @param[in] text key text
+     * @param[in] value value to store
+     */
+    void store(uint64_t key, const std::string& text, const Value& value)
+    {
+        Shard& shard = shard_for(key);
+        std::lock_guard<std::mutex> lock(shard.lock);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end())
+        {
+            shard.items.erase(it->second);
+            shard.index.erase(it);
+        }
+        else if (shard.items.size() >= shard.capacity)
+        {
+            shard.index.erase(shard.items.back().key);
+            shard.items.pop_back();
+        }
+        shard.items.push_front(Entry{ key, text, value });
+        shard.index[key] = shard.items.begin();
+    }
+    /**
+     * @brief Remove all entries
+     */
+    void clear()
+    {
+        for (auto& shard : shards_)
+        {
+            std::lock_guard<std::mutex> lock(shard->lock);
+            shard->items.clear();
+            shard->index.clear();
+        }
+    }
+    /**
+     * @brief Remove all entries, if they were stored for another generation of the source data
+     * @param[in] generation current generation, e.g. LexemeLibrary::revision()
+     */
+    void expire(uint64_t generation)
+    {
+        if (generation_.load(std::memory_order_acquire) == generation)
+            return;
+        clear();
+        generation_.store(generation, std::memory_order_release);
+    }
+    /**
+     * @brief Number of lookups, that found a value
+     */
+    uint64_t hits() const
+    {
+        return hits_.load(std::memory_order_relaxed);
+    }
+    /**
+     * @brief Number of lookups, that found nothing
+     */
+    uint64_t misses() const
+    {
+        return misses_.load(std::memory_order_relaxed);
+    }
+    /**
+     * @brief Number of entries
+     */
+    size_t size() const
+    {
+        size_t n = 0;
+        for (auto& shard : shards_)
+        {
+            std::lock_guard<std::mutex> lock(shard->lock);
+            n += shard->items.size();
+        }
+        return n;
+    }
+private:
+    /**
+     * @brief Cache entry
+     */
+    struct Entry
+    {
+        uint64_t key;       ///< hash of text
+        std::string text;   ///< key text
+        Value value;        ///< cached value
+    };
+    /**
+     * @brief Independently locked part of the cache
+     */
+    struct Shard
+    {
+        std::mutex lock;                ///< guards items and index
+        size_t capacity;                ///< max number of entries
+        std::list<Entry> items;         ///< entries, most recently used first
+        std::unordered_map<uint64_t, typename std::list<Entry>::iterator> index;
+    };
+    
+    Shard& shard_for(uint64_t key)
+    {
+        return *shards_[(key >> 32 ^ key) % shards_.size()];
+    }
+private:
+    std::vector<std::unique_ptr<Shard>> shards_;    ///< cache shards
+    std::atomic<uint64_t> generation_;              ///< generation of the stored entries
+    std::atomic<uint64_t> hits_;                    ///< hit counter
+    std::atomic<uint64_t> misses_;                  ///< miss counter
+};
+
+#endif /* lrucache_hpp */
@@ -13,6 +13,7 @@
 
 #include <iostream>
 #include <set>
+#include <memory>
 
 /**
  * @brief Lexeme Tree
@@ -0,0 +1,81 @@
+/**
+ * @file manifest.hpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief Record of processed files for incremental runs
+ */
+
+#ifndef manifest_hpp
+#define manifest_hpp
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <mutex>
+
+/**
+ * @class Manifest
+ * @brief Content hashes of processed files
+ *
+ * For each input path the manifest stores the hash of the input,
+ * the fingerprint of the settings it was processed with and the hash
+ * of the produced output. A file is up to date, when all of them match.
+ *
+ * File format, one entry per line:
+ * @code
+ *     # ctex manifest 1
+ *     <input hash> <fingerprint> <output hash> <path>
+ * @endcode
+ */
+class Manifest
+{
+public:
+    /**
+     * @brief Manifest entry
+     */
+    struct Entry
+    {
+        uint64_t input_hash;    ///< @brief hash of the input content
+        uint64_t fingerprint;   ///< @brief settings fingerprint
+        uint64_t output_hash;   ///< @brief hash of the output content
+    };
+public:
+    Manifest();
+    ~Manifest() = default;
+public:
+    /**
+     * @brief Load entries from file
+     * @param[in] filename manifest file name
+     * @return false if file is missing or malformed, manifest is empty then
+     */
+    bool load(const std::string& filename);
+    /**
+     * @brief Save entries to file, the file is replaced atomically
+     * @param[in] filename manifest file name
+     * @return true on success
+     */
+    bool save(const std::string& filename) const;
+    /**
+     * @brief Get entry for the path
+     * @param[in] path input path
+     * @param[out] entry found entry
+     * @return false if there is no entry for the path
+     */
+    bool find(const std::string& path, Entry& entry) const;
+    /**
+     * @brief Add or replace entry for the path
+     * @param[in] path input path
+     * @param[in] entry entry to store
+     */
+    void update(const std::string& path, const Entry& entry);
+    /**
+     * @brief Number of entries
+     */
+    size_t size() const;
+private:
+    std::unordered_map<std::string, Entry> entries_;    ///< @brief entries by input path
+    mutable std::mutex lock_;                           ///< @brief guards entries_
+};
+
+#endif /* manifest_hpp */
@@ -0,0 +1,121 @@
+/**
+ * @file preview.hpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief JSON-RPC server for live formula previews in editors
+ */
+
+#ifndef preview_hpp
+#define preview_hpp
+
+#include "detector.hpp"
+#include "json.hpp"
+
+#include <istream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+/**
+ * @class PreviewServer
+ * @brief Keeps open documents and translates only statements, that changed
+ *
+ * JSON-RPC 2.0, one message per line on stdin/stdout:
+ * @code
+ *     -> {"jsonrpc":"2.0","id":1,"method":"open","params":{"uri":"a.c","text":"y = a*b;\n"}}
+ *     <- {"jsonrpc":"2.0","id":1,"result":{"changed":[{"id":1,"line":0,"input":"y = a*b;","latex":"..."}],"moved":[],"removed":[]}}
+ *     -> {"jsonrpc":"2.0","id":2,"method":"change","params":{"uri":"a.c","edits":[{"start":0,"end":0,"text":"\n"}]}}
+ *     <- {"jsonrpc":"2.0","id":2,"result":{"changed":[],"moved":[{"id":1,"line":1}],"removed":[]}}
+ *     -> {"jsonrpc":"2.0","method":"close","params":{"uri":"a.c"}}
+ *     -> {"jsonrpc":"2.0","id":3,"method":"shutdown"}
+ * @endcode
+ * An edit replaces lines `[start, end)` with `text`; `"text"` instead of
+ * `"edits"` replaces the whole document. Each statement has an id, that is
+ * kept while the statement tokens (its text up to whitespaces) stay the same,
+ * so after an edit only new statements are translated and reported as `changed`,
+ * statements, that only shifted, are reported as `moved`, and disappeared ones
+ * as `removed`. `open` accepts `"style"`: `"doxygen"` (default), `"display"`
+ * or `"inline"`. Notifications (requests without id) get no response.
+ *
+ * Statements rejected by the detector filter are not reported.
+ */
+class PreviewServer
+{
+public:
+    /**
+     * @param[in] detector detector to find statements and translate them
+     */
+    explicit PreviewServer(Detector& detector);
+    ~PreviewServer() = default;
+public:
+    /**
+     * @brief Serve requests until shutdown or end of input
+     * @param[in] in request stream
+     * @param[in] out response sink, flushed after every response
+     */
+    void run(std::istream& in, Writer& out);
+    /**
+     * @brief Handle one JSON-RPC message
+     * @param[in] message request text
+     * @param[out] response response text, empty for notifications
+     * @return false after shutdown request
+     */
+    bool handle(const std::string& message, std::string& response);
+private:
+    /**
+     * @brief Translated statement of a document
+     */
+    struct Entry
+    {
+        uint64_t id;            ///< @brief stable statement id
+        size_t line;            ///< @brief zero based line, where the statement starts
+        size_t lines;           ///< @brief number of lines, the statement spans
+        bool shown;             ///< @brief passes the detector filter, reported to the client
+        std::string key;        ///< @brief statement text with squeezed whitespaces
+        std::string input;      ///< @brief statement text
+        std::string latex;      ///< @brief translation
+    };
+    /**
+     * @brief Open document
+     */
+    struct Document
+    {
+        std::vector<std::string> lines; ///< @brief text lines without line breaks
+        std::vector<Entry> entries;     ///< @brief statements in text order
+        CTex::EQUATION_TAG_STYLE style; ///< @brief equation tags of translations
+        size_t head;                    ///< @brief leading lines, that did not change since update
+        size_t tail;                    ///< @brief trailing lines, that did not change since update
+        size_t scanned;                 ///< @brief number of lines at the last update
+    };
+    /**
+     * @brief Replace lines [start, end) with text
+     * @return false if the range is invalid
+     */
+    static bool edit(Document& doc, size_t start, size_t end, const std::string& text);
+    /**
+     * @brief Find statements in the changed lines and translate new ones
+     *
+     * Only lines between the statements around the change are scanned,
+     * the whole document is scanned when the statements found at the ends
+     * differ from the known ones, e.g. after an edit opens a comment.
+     * @return changes in protocol form
+     */
+    json::Value update(Document& doc);
+    /**
+     * @brief Execute method
+     * @param[in] method method name
+     * @param[in] params method parameters
+     * @param[out] code JSON-RPC error code, when the method fails
+     * @param[out] error error message, when the method fails
+     * @return result
+     */
+    json::Value call(const std::string& method, const json::Value& params, int& code, std::string& error);
+private:
+    Detector& detector_;                                ///< @brief statement source
+    std::unordered_map<std::string, Document> docs_;    ///< @brief open documents by uri
+    uint64_t next_id_;                                  ///< @brief id of the next new statement
+    bool shutdown_;                                     ///< @brief shutdown is requested
+};
+
+#endif /* preview_hpp */
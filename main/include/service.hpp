@@ -0,0 +1,85 @@
+/**
+ * @file service.hpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief Resident translation service on a Unix domain socket
+ */
+
+#ifndef service_hpp
+#define service_hpp
+
+#include "detector.hpp"
+
+#include <string>
+#include <ostream>
+#include <atomic>
+
+/**
+ * @class Service
+ * @brief Keeps the grammar and caches warm between per-file invocations
+ *
+ * Protocol, one request per connection:
+ * @code
+ *     client: C source, then shuts down its sending side
+ *     server: processed source, then closes the connection
+ *     server: NUL byte and error message instead, if the source is rejected
+ * @endcode
+ * Connections are served concurrently by a thread pool sharing one Detector.
+ * The client never touches the grammar, so its cost is a process start
+ * and a round trip. Available on POSIX systems only.
+ */
+class Service
+{
+public:
+    /**
+     * @param[in] detector detector shared by all connections
+     * @param[in] threads number of workers, 0 - number of hardware threads
+     */
+    Service(Detector& detector, size_t threads = 0);
+    ~Service();
+    
+    Service(const Service&) = delete;
+    Service& operator=(const Service&) = delete;
+public:
+    /**
+     * @brief Bind to socket, stale socket file is replaced
+     * @param[in] socket_path socket file name
+     * @return false if the socket can't be bound
+     */
+    bool listen(const std::string& socket_path);
+    /**
+     * @brief Serve connections until stop is called
+     */
+    void run();
+    /**
+     * @brief Make run return, safe to call from a signal handler
+     */
+    void stop();
+    /**
+     * @brief Send source to the service and stream back the result
+     * @param[in] socket_path socket file name
+     * @param[in] data C source
+     * @param[in] size source size in bytes
+     * @param[in] out receives processed source
+     * @param[out] error receives the reason, if the service rejected the request
+     * @return false if the service is not reachable, the connection is broken
+     * or the request is rejected
+     */
+    static bool request(const std::string& socket_path, const char* data, size_t size, std::ostream& out,
+                        std::string* error = nullptr);
+private:
+    /**
+     * @brief Process one request and close the connection
+     * @param[in] fd connected socket
+     */
+    void serve(int fd);
+private:
+    Detector& detector_;            ///< @brief shared detector
+    size_t threads_;                ///< @brief number of workers
+    int listen_fd_;                 ///< @brief listening socket or -1
+    std::string socket_path_;       ///< @brief bound socket file
+    std::atomic<bool> stopped_;     ///< @brief stop is requested
+};
+
+#endif /* service_hpp */
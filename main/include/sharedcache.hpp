@@ -0,0 +1,109 @@
+/**
+ * @file sharedcache.hpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief Translation cache shared between concurrent processes
+ */
+
+#ifndef sharedcache_hpp
+#define sharedcache_hpp
+
+#include "diskcache.hpp"
+
+#include <cstdint>
+#include <string>
+
+/**
+ * @class SharedCache
+ * @brief Concurrent hash table of formula translations in a shared memory mapped file
+ *
+ * Every ctex process started with the same file attaches to the same table:
+ * @code
+ *     header  : magic, state, slot count, data capacity, used data size
+ *     slots   : { key, record reference } open addressing, linear probing
+ *     data    : { text, group hits, latex } records, append only
+ * @endcode
+ * Readers never lock. A writer reserves space in the data section with
+ * an atomic add, copies the record and publishes it by claiming an empty
+ * slot with compare-and-swap and then storing the record reference.
+ * Entries are never removed, once the data section or the slots are
+ * exhausted new translations are simply not shared.
+ * The table is not persistent by design: remove the file to reset it.
+ * Available on POSIX systems only.
+ */
+class SharedCache
+{
+public:
+    /**
+     * @brief Default number of slots, must be a power of two
+     */
+    static const size_t default_slots = 1 << 16;
+    /**
+     * @brief Default data section capacity in bytes
+     */
+    static const size_t default_capacity = 32 << 20;
+public:
+    /**
+     * @param[in] slots number of slots, rounded up to a power of two;
+     * used only by the process that creates the table
+     * @param[in] capacity data section capacity in bytes;
+     * used only by the process that creates the table
+     */
+    explicit SharedCache(size_t slots = default_slots, size_t capacity = default_capacity);
+    ~SharedCache();
+
+    SharedCache(const SharedCache&) = delete;
+    SharedCache& operator=(const SharedCache&) = delete;
+public:
+    /**
+     * @brief Attach to the table, the file is created and initialized if missing
+     * @param[in] filename shared file name
+     * @return false if the table can't be used
+     */
+    bool open(const std::string& filename);
+    /**
+     * @brief Detach from the table
+     */
+    void close();
+    /**
+     * @brief Checks whether the table is attached
+     */
+    bool good() const;
+    /**
+     * @brief Find translation
+     * @param[in] key hash of the text and the grammar
+     * @param[in] text normalized formula, protects from hash collisions
+     * @param[out] value found translation
+     * @return true on hit
+     */
+    bool lookup(uint64_t key, const std::string& text, DiskCache::Value& value) const;
+    /**
+     * @brief Publish translation to all attached processes
+     * @param[in] key hash of the text and the grammar
+     * @param[in] text normalized formula
+     * @param[in] value translation
+     * @return false if the key is already taken or the table is full
+     */
+    bool store(uint64_t key, const std::string& text, const DiskCache::Value& value);
+    /**
+     * @brief Number of published entries
+     */
+    size_t size() const;
+private:
+    struct Header;
+    struct Slot;
+    /**
+     * @brief Slot at the given position
+     */
+    Slot* slot(size_t index) const;
+private:
+    size_t slots_;          ///< @brief requested number of slots
+    size_t capacity_;       ///< @brief requested data capacity
+    char* map_;             ///< @brief mapped file
+    size_t map_size_;       ///< @brief mapped size
+    Header* header_;        ///< @brief table header
+    char* data_;            ///< @brief data section
+};
+
+#endif /* sharedcache_hpp */
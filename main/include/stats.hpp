@@ -0,0 +1,197 @@
+/**
+ * @file stats.hpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief Per-stage timers and counters of a run
+ */
+
+#ifndef stats_hpp
+#define stats_hpp
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+/**
+ * @brief Set to 0 to compile timers and counters out,
+ * see the CTEX_STATS cmake option
+ */
+#ifndef CTEX_STATS
+#define CTEX_STATS 1
+#endif
+
+/**
+ * @brief Time the rest of the enclosing scope as a stats::Stage
+ *
+ * Usage example:
+ * @code{.cpp}
+ *     std::string LexemeTree::transform()
+ *     {
+ *         STATS_SCOPE(Transform);
+ *         ...
+ *     }
+ * @endcode
+ */
+#if CTEX_STATS
+#define STATS_CONCAT_(a, b) a##b
+#define STATS_CONCAT(a, b) STATS_CONCAT_(a, b)
+#define STATS_SCOPE(stage) stats::Timer STATS_CONCAT(stats_timer_, __LINE__)(stats::stage)
+#define STATS_COUNT(counter, n) stats::count(stats::counter, n)
+#else
+#define STATS_SCOPE(stage) ((void)0)
+#define STATS_COUNT(counter, n) ((void)0)
+#endif
+
+/**
+ * @brief Time GLOG_TRACE and GLOG_DEBUG messages as the Logging stage,
+ * in files, that include this header, see glogger.hpp
+ */
+#undef GLOGGER_SCOPE_HOOK
+#if CTEX_STATS
+#define GLOGGER_SCOPE_HOOK() STATS_SCOPE(Logging)
+#else
+#define GLOGGER_SCOPE_HOOK() ((void)0)
+#endif
+
+/**
+ * @brief Timers and counters, enabled by `--stats`
+ *
+ * Every thread accumulates into its own slots, so timing a scope costs
+ * two clock reads and no shared writes; slots of all threads are summed
+ * only by snapshot(). Time of nested scopes is subtracted from the
+ * enclosing one, so stage times add up to the time spent in all stages.
+ * Disabled timers cost two relaxed loads.
+ */
+namespace stats
+{
+    /**
+     * @brief Timed stages
+     */
+    enum Stage
+    {
+        Input = 0,      ///< opening and mapping source files
+        Detection,      ///< scanning sources for formulas
+        Translation,    ///< caches and equation tags of a formula
+        Lexing,         ///< CTex::lexical_analyzer
+        Sorting,        ///< classification and sorting of lexemes
+        TreeBuilding,   ///< insert passes of the lexeme tree
+        Transform,      ///< LexemeTree::transform
+        Formatting,     ///< comment blocks around translations
+        Logging,        ///< formatting and writing trace and debug messages
+        Output,         ///< writing results
+        StageCount
+    };
+    /**
+     * @brief Event counters
+     */
+    enum Counter
+    {
+        Files = 0,      ///< processed sources
+        Formulas,       ///< translated formulas
+        Tokens,         ///< lexemes found by the lexical analyzer
+        InputBytes,     ///< size of processed sources
+        OutputBytes,    ///< size of written results
+        CounterCount
+    };
+    /**
+     * @brief Totals of all threads
+     */
+    struct Snapshot
+    {
+        uint64_t time[StageCount];      ///< @brief nanoseconds spent in each stage
+        uint64_t calls[StageCount];     ///< @brief number of timed scopes of each stage
+        uint64_t counters[CounterCount];///< @brief counter values
+        uint64_t wall;                  ///< @brief nanoseconds since enable(true)
+    };
+
+    /**
+     * @brief Collecting is on, use enabled()
+     */
+    extern std::atomic<bool> collecting;
+    /**
+     * @brief Tracing is on, timers record trace events, see trace.hpp
+     */
+    extern std::atomic<bool> tracing;
+    /**
+     * @brief Checks whether timers are compiled in
+     */
+    constexpr bool compiled()
+    {
+        return CTEX_STATS != 0;
+    }
+    /**
+     * @brief Start or stop collecting, has no effect if timers are compiled out
+     */
+    void enable(bool on);
+    /**
+     * @brief Checks whether collecting is on
+     */
+    inline bool enabled()
+    {
+        return compiled() && collecting.load(std::memory_order_relaxed);
+    }
+    /**
+     * @brief Lower case name of a stage
+     */
+    const char* stage_name(Stage stage);
+    /**
+     * @brief Lower case name of a counter
+     */
+    const char* counter_name(Counter counter);
+    /**
+     * @brief Increase counter of the calling thread
+     */
+    void add(Counter counter, uint64_t n);
+    /**
+     * @brief Increase counter if collecting is on
+     */
+    inline void count(Counter counter, uint64_t n = 1)
+    {
+        if (enabled())
+            add(counter, n);
+    }
+    /**
+     * @brief Sum slots of running and finished threads
+     */
+    Snapshot snapshot();
+    /**
+     * @brief Write snapshot as a table or as a JSON object
+     */
+    void report(std::ostream& out, bool json);
+
+    /**
+     * @class Timer
+     * @brief Adds the lifetime of the object to the stage of the calling thread
+     * @note Timers of a thread must be destroyed in reverse order of creation,
+     * use them as scoped objects only
+     */
+    class Timer
+    {
+    public:
+        explicit Timer(Stage stage) :
+        active_(enabled() || (compiled() && tracing.load(std::memory_order_relaxed)))
+        {
+            if (active_)
+                start(stage);
+        }
+        ~Timer()
+        {
+            if (active_)
+                stop();
+        }
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+    private:
+        void start(Stage stage);
+        void stop();
+    private:
+        bool active_;           ///< @brief collecting was on at creation
+        Stage stage_;           ///< @brief timed stage
+        Timer* parent_;         ///< @brief enclosing timer of the thread
+        int64_t start_;         ///< @brief creation time, ns
+        int64_t children_;      ///< @brief time of nested timers, ns
+    };
+}
+
+#endif /* stats_hpp */
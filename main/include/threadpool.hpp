@@ -0,0 +1,66 @@
+/**
+ * @file threadpool.hpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief Fixed size pool of worker threads
+ */
+
+#ifndef threadpool_hpp
+#define threadpool_hpp
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+
+/**
+ * @class ThreadPool
+ * @brief Runs submitted tasks on a fixed number of worker threads
+ *
+ * Tasks are taken in submission order. The destructor waits
+ * until all submitted tasks are done.
+ */
+class ThreadPool
+{
+public:
+    /**
+     * @param[in] threads number of workers, 0 - number of hardware threads
+     */
+    explicit ThreadPool(size_t threads = 0);
+    ~ThreadPool();
+    
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+public:
+    /**
+     * @brief Queue task for execution
+     * @param[in] task task to run on a worker
+     */
+    void submit(std::function<void()> task);
+    /**
+     * @brief Block until all submitted tasks are done
+     */
+    void wait();
+    /**
+     * @brief Number of workers
+     */
+    size_t size() const;
+private:
+    /**
+     * @brief Worker loop
+     */
+    void work();
+private:
+    std::vector<std::thread> workers_;              ///< @brief worker threads
+    std::deque<std::function<void()>> tasks_;       ///< @brief queued tasks
+    std::mutex lock_;                               ///< @brief guards tasks_, active_ and stopping_
+    std::condition_variable ready_;                 ///< @brief signals new task or stop
+    std::condition_variable idle_;                  ///< @brief signals that all tasks are done
+    size_t active_;                                 ///< @brief number of running tasks
+    bool stopping_;                                 ///< @brief destructor is called
+};
+
+#endif /* threadpool_hpp */
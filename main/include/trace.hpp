@@ -0,0 +1,116 @@
+/**
+ * @file trace.hpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief Chrome trace events of a run
+ */
+
+#ifndef trace_hpp
+#define trace_hpp
+
+#include "stats.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Record the rest of the enclosing scope as a trace event
+ *
+ * Usage example:
+ * @code{.cpp}
+ *     TRACE_SPAN("io", "file", filename);
+ * @endcode
+ */
+#if CTEX_STATS
+#define TRACE_SPAN(category, name, detail) \
+    trace::Span STATS_CONCAT(trace_span_, __LINE__)(category, name, detail)
+#else
+#define TRACE_SPAN(category, name, detail) ((void)0)
+#endif
+
+/**
+ * @brief Trace events in the Chrome trace event format, enabled by `--trace`
+ *
+ * The result is a JSON file, that can be opened in chrome://tracing or
+ * https://ui.perfetto.dev. Every thread collects events into its own
+ * buffer and appends it to the file, when the buffer is full, when the
+ * thread exits and on stop(). Timers of stats.hpp record a span
+ * per stage, when tracing is on. Compiled out together with stats.hpp.
+ */
+namespace trace
+{
+    /**
+     * @brief Checks whether tracing is on
+     */
+    inline bool enabled()
+    {
+        return stats::compiled() && stats::tracing.load(std::memory_order_relaxed);
+    }
+    /**
+     * @brief Create trace file and start tracing
+     * @param[in] filename trace file name
+     * @return false if the file can't be created or timers are compiled out
+     */
+    bool start(const std::string& filename);
+    /**
+     * @brief Write events of all threads and finish the trace file
+     * @return false if writing failed
+     * @note Threads, that keep running, may record events only after start()
+     */
+    bool stop();
+    /**
+     * @brief Name of the calling thread in the trace, "thread" by default
+     */
+    void set_thread_name(const std::string& name);
+    /**
+     * @brief Record complete event of the calling thread
+     * @param[in] category event category
+     * @param[in] name event name, a string literal
+     * @param[in] begin start time, steady clock nanoseconds
+     * @param[in] end end time, steady clock nanoseconds
+     * @param[in] detail value of the `detail` argument, omitted if empty
+     */
+    void complete(const char* category, const char* name, int64_t begin, int64_t end,
+                  const std::string& detail);
+    /**
+     * @brief Steady clock nanoseconds
+     */
+    int64_t now();
+
+    /**
+     * @class Span
+     * @brief Records the lifetime of the object as a complete event
+     */
+    class Span
+    {
+    public:
+        Span(const char* category, const char* name, const std::string& detail) :
+        active_(enabled())
+        {
+            if (active_)
+            {
+                category_ = category;
+                name_ = name;
+                detail_ = detail;
+                begin_ = now();
+            }
+        }
+        ~Span()
+        {
+            if (active_)
+                complete(category_, name_, begin_, now(), detail_);
+        }
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+    private:
+        bool active_;               ///< @brief tracing was on at creation
+        const char* category_;      ///< @brief event category
+        const char* name_;          ///< @brief event name
+        std::string detail_;        ///< @brief event argument
+        int64_t begin_;             ///< @brief creation time, ns
+    };
+}
+
+#endif /* trace_hpp */
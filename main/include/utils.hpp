@@ -11,6 +11,9 @@
 
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <functional>
+#include <cctype>
 
 namespace str
 {
@@ -108,6 +111,28 @@ namespace str
         rtrim(s);
         return s;
     }
+    /**
+     Replace each run of whitespaces with a single space and trim the result
+
+     @param s string to process
+     @return processed string
+     */
+    inline std::string squeezed(const std::string& s) {
+        std::string res;
+        res.reserve(s.size());
+        bool space = false;
+        for (auto c : s) {
+            if (std::isspace(static_cast<unsigned char>(c))) {
+                space = !res.empty();
+                continue;
+            }
+            if (space)
+                res.push_back(' ');
+            res.push_back(c);
+            space = false;
+        }
+        return res;
+    }
 }
 
 #endif /* utils_hpp */
@@ -0,0 +1,107 @@
+/**
+ * @file writer.hpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief Buffered output sink
+ */
+
+#ifndef writer_hpp
+#define writer_hpp
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @class Writer
+ * @brief Accumulates output in a large buffer and passes it
+ * to the target with a few large writes
+ *
+ * Besides copied data Writer accepts references to external memory
+ * (e.g. a mapped input file). When the target is a file descriptor,
+ * referenced spans are never copied into the buffer, but gathered
+ * with the buffered data into a single `writev` call.
+ *
+ * Usage example:
+ * @code{.cpp}
+ *     Writer writer(out);
+ *     writer << line << '\n';
+ *     writer.write_ref(mapped + offset, length);  // must stay valid until flush
+ *     writer.flush();      // also performed by the destructor
+ * @endcode
+ */
+class Writer
+{
+public:
+    /**
+     * @brief Default buffer capacity in bytes
+     */
+    static const size_t default_capacity = 1 << 20;
+public:
+    /**
+     * @param[in] out target stream
+     * @param[in] capacity buffer capacity in bytes
+     */
+    explicit Writer(std::ostream& out, size_t capacity = default_capacity);
+#ifndef _WIN32
+    /**
+     * @param[in] fd target file descriptor, stays owned by the caller
+     * @param[in] capacity buffer capacity in bytes
+     */
+    explicit Writer(int fd, size_t capacity = default_capacity);
+#endif
+    ~Writer();
+    
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+public:
+    /**
+     * @brief Append data to the buffer, write the buffer out when it is full
+     * @param[in] data data to write
+     * @param[in] size data size in bytes
+     */
+    void write(const char* data, size_t size);
+    /**
+     * @brief Append a reference to data without copying it
+     * @param[in] data data to write, must stay valid until the next flush
+     * @param[in] size data size in bytes
+     * @note copies data when the target is a stream
+     */
+    void write_ref(const char* data, size_t size);
+    /**
+     * @brief Write pending data and flush the target
+     */
+    void flush();
+    /**
+     * @brief Checks whether all writes succeeded
+     */
+    bool good() const;
+    
+    Writer& operator<<(const std::string& s);
+    Writer& operator<<(const char* s);
+    Writer& operator<<(char c);
+private:
+    /**
+     * @brief Pending output span: external data or a part of the buffer
+     */
+    struct Segment
+    {
+        const char* ref;    ///< external data or nullptr for buffered data
+        size_t offset;      ///< offset in the buffer for buffered data
+        size_t size;        ///< span size
+    };
+    /**
+     * @brief Write pending data to the target
+     */
+    void drain();
+private:
+    std::ostream* out_;             ///< @brief target stream or nullptr
+    int fd_;                        ///< @brief target file descriptor or -1
+    std::string buffer_;            ///< @brief copied output
+    std::vector<Segment> segments_; ///< @brief pending output in order
+    size_t capacity_;               ///< @brief buffer capacity
+    bool good_;                     ///< @brief no write errors so far
+};
+
+#endif /* writer_hpp */
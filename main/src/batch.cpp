@@ -0,0 +1,144 @@
+/**
+ * @file batch.cpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief Bulk translation of formulas streamed through stdin/stdout
+ */
+
+#include "batch.hpp"
+#include "threadpool.hpp"
+#include "json.hpp"
+
+#include <vector>
+#include <algorithm>
+
+namespace
+{
+    /**
+     * @brief Checks whether reading from the stream would block
+     */
+    bool would_block(std::istream& in)
+    {
+        return in.rdbuf()->in_avail() <= 0;
+    }
+}
+
+Batch::Batch(std::shared_ptr<CTex> ctex, size_t threads) :
+ctex_(ctex)
+, threads_(std::max<size_t>(1, threads))
+{ }
+
+size_t Batch::run(std::istream& in, Writer& out, Format format)
+{
+    std::unique_ptr<ThreadPool> pool;
+    if (threads_ > 1)
+        pool.reset(new ThreadPool(threads_));
+    std::vector<std::string> lines;
+    std::vector<std::string> results;
+    std::vector<char> produced;
+    std::string line;
+    size_t total = 0;
+    bool eof = false;
+    while (!eof)
+    {
+        // collect lines, that are available now
+        lines.clear();
+        while (lines.size() < chunk_size)
+        {
+            if (!std::getline(in, line))
+            {
+                eof = true;
+                break;
+            }
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            lines.push_back(line);
+            if (would_block(in))
+                break;
+        }
+        results.assign(lines.size(), std::string());
+        produced.assign(lines.size(), 0);
+        auto work = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+            {
+                produced[i] = translate(lines[i], format, results[i]);
+            }
+        };
+        if (pool && lines.size() > 1)
+        {
+            size_t step = (lines.size() + threads_ - 1) / threads_;
+            for (size_t begin = 0; begin < lines.size(); begin += step)
+            {
+                size_t end = std::min(lines.size(), begin + step);
+                pool->submit([&work, begin, end]() { work(begin, end); });
+            }
+            pool->wait();
+        }
+        else
+        {
+            work(0, lines.size());
+        }
+        for (size_t i = 0; i < lines.size(); ++i)
+        {
+            if (produced[i])
+                out << results[i] << '\n';
+        }
+        total += lines.size();
+        if (eof || would_block(in))
+            out.flush();
+    }
+    return total;
+}
+
+bool Batch::translate(const std::string& line, Format format, std::string& result) const
+{
+    if (format == Lines)
+    {
+        result = line.empty() ? std::string() : ctex_->translate(line).latex;
+        return true;
+    }
+    if (line.find_first_not_of(" \t") == std::string::npos)
+        return false;
+    json::Value request;
+    json::Value response = json::Value::object();
+    if (!json::Value::parse(line, request) || !request.is_object())
+    {
+        response.set("id", json::Value());
+        response.set("error", "invalid JSON request");
+        result = response.dump();
+        return true;
+    }
+    response.set("id", request["id"]);
+    const json::Value& formula = request["formula"];
+    const std::string& style = request["style"].as_string();
+    CTex::EQUATION_TAG_STYLE tag = CTex::DOXYFILE;
+    if (style == "display")
+        tag = CTex::DISPLAY;
+    else if (style == "inline")
+        tag = CTex::INLINE;
+    if (!formula.is_string())
+    {
+        response.set("error", "request has no formula");
+    }
+    else if (!style.empty() && style != "doxygen" && tag == CTex::DOXYFILE)
+    {
+        response.set("error", "unknown style: " + style);
+    }
+    else
+    {
+        auto translation = ctex_->translate(formula.as_string(), tag);
+        response.set("latex", translation.latex);
+        if (!translation.diagnostics.empty())
+        {
+            json::Value diagnostics = json::Value::array();
+            for (auto& d : translation.diagnostics)
+            {
+                diagnostics.push(d);
+            }
+            response.set("diagnostics", diagnostics);
+        }
+    }
+    result = response.dump();
+    return true;
+}
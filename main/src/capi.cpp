@@ -0,0 +1,231 @@
+/**
+ * @file capi.cpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief C interface of libctex
+ */
+
+#include "ctex.h"
+#include "ctex.hpp"
+#include "detector.hpp"
+#include "threadpool.hpp"
+#include "glogger.hpp"
+#include "lexeme.hpp"
+
+#include <cstring>
+#include <sstream>
+#include <algorithm>
+#include <new>
+#include <mutex>
+
+struct ctex_grammar
+{
+    std::shared_ptr<CTex> ctex;
+    std::unique_ptr<Detector> detector;
+};
+
+namespace
+{
+    bool to_style(int style, CTex::EQUATION_TAG_STYLE& tag)
+    {
+        switch (style)
+        {
+            case CTEX_STYLE_DOXYGEN: tag = CTex::DOXYFILE; return true;
+            case CTEX_STYLE_DISPLAY: tag = CTex::DISPLAY; return true;
+            case CTEX_STYLE_INLINE: tag = CTex::INLINE; return true;
+        }
+        return false;
+    }
+    
+    /**
+     * @brief Copy result to caller buffer, truncating if needed
+     */
+    long store(const std::string& result, char* buffer, size_t capacity)
+    {
+        if (capacity)
+        {
+            size_t n = std::min(result.size(), capacity - 1);
+            std::memcpy(buffer, result.data(), n);
+            buffer[n] = '\0';
+        }
+        return static_cast<long>(result.size());
+    }
+    
+    /**
+     * @brief Library defaults, set by the first ctex_create:
+     * lexemes of the command line tool
+     */
+    void init()
+    {
+        static std::once_flag once;
+        std::call_once(once, []() {
+            LexemeLibrary::add_extensions();
+        });
+    }
+}
+
+extern "C"
+{
+
+int ctex_api_version(void)
+{
+    return CTEX_API_VERSION;
+}
+
+ctex_grammar* ctex_create(void)
+{
+    try {
+        init();
+        std::unique_ptr<ctex_grammar> g(new ctex_grammar());
+        g->ctex = std::make_shared<CTex>(CTex::default_regex());
+        if (!g->ctex->prepare())
+            return nullptr;
+        g->detector.reset(new Detector(g->ctex));
+        return g.release();
+    }
+    catch (std::exception& ex)
+    {
+        GLogger::instance().logError(__func__, " : ", ex.what());
+        return nullptr;
+    }
+    catch (...)
+    {
+        GLogger::instance().logError(__func__, " : unknown exception");
+        return nullptr;
+    }
+}
+
+void ctex_free(ctex_grammar* grammar)
+{
+    delete grammar;
+}
+
+int ctex_set_log_level(int level)
+{
+    static_assert(int(CTEX_LOG_TRACE) == int(GLogger::Trace) && int(CTEX_LOG_ERROR) == int(GLogger::Error),
+                  "log levels of the C interface follow GLogger::Level");
+    if (level < CTEX_LOG_TRACE || level > CTEX_LOG_OFF)
+        return -1;
+    auto& logger = GLogger::instance();
+    if (level == CTEX_LOG_OFF)
+    {
+        logger.set_output_mode(GLogger::Output::Off);
+        return 0;
+    }
+    logger.set_output_mode(GLogger::Output::Console);
+    logger.set_min_level(GLogger::Output::Console, static_cast<GLogger::Level>(level));
+    return 0;
+}
+
+long ctex_translate(ctex_grammar* grammar, const char* formula, int style,
+                    char* buffer, size_t capacity)
+{
+    CTex::EQUATION_TAG_STYLE tag;
+    if (!grammar || !formula || (!buffer && capacity) || !to_style(style, tag))
+        return -1;
+    try {
+        return store(grammar->ctex->translate(formula, tag).latex, buffer, capacity);
+    }
+    catch (std::exception& ex)
+    {
+        GLogger::instance().logError(__func__, " : ", ex.what());
+        return -1;
+    }
+    catch (...)
+    {
+        GLogger::instance().logError(__func__, " : unknown exception");
+        return -1;
+    }
+}
+
+long ctex_translate_batch(ctex_grammar* grammar, const char* const* formulas, size_t count,
+                          int style, size_t threads, char* buffer, size_t capacity, size_t* offsets)
+{
+    CTex::EQUATION_TAG_STYLE tag;
+    if (!grammar || (!formulas && count) || (!buffer && capacity) || !to_style(style, tag))
+        return -1;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!formulas[i])
+            return -1;
+    }
+    try {
+        std::vector<std::string> results(count);
+        auto work = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+            {
+                results[i] = grammar->ctex->translate(formulas[i], tag).latex;
+            }
+        };
+        if (threads > 1 && count > 1)
+        {
+            ThreadPool pool(threads);
+            size_t step = (count + threads - 1) / threads;
+            for (size_t begin = 0; begin < count; begin += step)
+            {
+                size_t end = std::min(count, begin + step);
+                pool.submit([&work, begin, end]() { work(begin, end); });
+            }
+            pool.wait();
+        }
+        else
+        {
+            work(0, count);
+        }
+        size_t total = 0;
+        for (auto& r : results)
+        {
+            total += r.size() + 1;
+        }
+        if (total <= capacity)
+        {
+            size_t offset = 0;
+            for (size_t i = 0; i < count; ++i)
+            {
+                std::memcpy(buffer + offset, results[i].c_str(), results[i].size() + 1);
+                if (offsets)
+                    offsets[i] = offset;
+                offset += results[i].size() + 1;
+            }
+        }
+        return static_cast<long>(total);
+    }
+    catch (std::exception& ex)
+    {
+        GLogger::instance().logError(__func__, " : ", ex.what());
+        return -1;
+    }
+    catch (...)
+    {
+        GLogger::instance().logError(__func__, " : unknown exception");
+        return -1;
+    }
+}
+
+long ctex_process(ctex_grammar* grammar, const char* source, size_t size,
+                  char* buffer, size_t capacity)
+{
+    if (!grammar || (!source && size) || (!buffer && capacity))
+        return -1;
+    try {
+        std::ostringstream stream;
+        {
+            Writer out(stream);
+            grammar->detector->perform(source, size, out);
+        }
+        return store(stream.str(), buffer, capacity);
+    }
+    catch (std::exception& ex)
+    {
+        GLogger::instance().logError(__func__, " : ", ex.what());
+        return -1;
+    }
+    catch (...)
+    {
+        GLogger::instance().logError(__func__, " : unknown exception");
+        return -1;
+    }
+}
+
+}
@@ -10,6 +10,18 @@
 #include "ltree.hpp"
 #include "glogger.hpp"
 #include "i18n.hpp"
+#include "hash.hpp"
+#include "utils.hpp"
+#include "trace.hpp"
+
+namespace
+{
+    /**
+     * @brief Version of the translation output,
+     * must be increased whenever transformations change
+     */
+    const std::string output_version = "ctex-1";
+}
 
 //-------------------------------------------------------------------//
 // Constructors, Destructor, Copy/Move Operators
@@ -18,6 +30,9 @@
 
 CTex::CTex(const std::vector<std::pair<std::string, std::string>>& grouped_regs)
 : grouped_regs_(grouped_regs)
+, cache_seed_(0)
+, revision_(LexemeLibrary::revision())
+, default_grammar_(grouped_regs == default_regex())
 {
     // build full regex expresion
     for (auto const& x : grouped_regs_)
@@ -27,7 +42,7 @@ CTex::CTex(const std::vector<std::pair<std::string, std::string>>& grouped_regs)
     regex_txt_.pop_back();  // remove last pipe
     
     // notify about regex expression
-    GLogger::instance().logDebug("Regex:"_i18n, regex_txt_);
+    GLOG_DEBUG("Regex:"_i18n, regex_txt_);
     
     // init grouped_hits_ map
     for (auto& d : grouped_regs_)
@@ -40,6 +55,12 @@ CTex::CTex(const CTex& other) :
 regex_txt_(other.regex_txt_)
 , grouped_regs_(other.grouped_regs_)
 , grouped_hits_(other.grouped_hits_)
+, disk_cache_(other.disk_cache_)
+, shared_cache_(other.shared_cache_)
+, memo_(other.memo_)
+, cache_seed_(other.cache_seed_.load())
+, revision_(other.revision_.load())
+, default_grammar_(other.default_grammar_)
 { }
 
 
@@ -48,8 +69,15 @@ CTex& CTex::operator=(const CTex& other)
     if(this != &other)
     {
         regex_txt_ = other.regex_txt_;
+        grammar_.reset();   // compiled again on demand
         grouped_regs_ = other.grouped_regs_;
         grouped_hits_ = other.grouped_hits_;
+        disk_cache_ = other.disk_cache_;
+        shared_cache_ = other.shared_cache_;
+        memo_ = other.memo_;
+        cache_seed_ = other.cache_seed_.load();
+        revision_ = other.revision_.load();
+        default_grammar_ = other.default_grammar_;
     }
     return *this;
 }
@@ -58,6 +86,12 @@ CTex::CTex(CTex &&other)  :
 regex_txt_(std::move(other.regex_txt_))
 , grouped_regs_(std::move(other.grouped_regs_))
 , grouped_hits_(std::move(other.grouped_hits_))
+, disk_cache_(std::move(other.disk_cache_))
+, shared_cache_(std::move(other.shared_cache_))
+, memo_(std::move(other.memo_))
+, cache_seed_(other.cache_seed_.load())
+, revision_(other.revision_.load())
+, default_grammar_(other.default_grammar_)
 { }
 
 
@@ -66,8 +100,15 @@ CTex& CTex::operator=(CTex &&other)
     if(this != &other)
     {
         regex_txt_ = std::move(other.regex_txt_);
+        grammar_.reset();
         grouped_regs_ = std::move(other.grouped_regs_);
         grouped_hits_ = std::move(other.grouped_hits_);
+        disk_cache_ = std::move(other.disk_cache_);
+        shared_cache_ = std::move(other.shared_cache_);
+        memo_ = std::move(other.memo_);
+        cache_seed_ = other.cache_seed_.load();
+        revision_ = other.revision_.load();
+        default_grammar_ = other.default_grammar_;
     }
     return *this;
 }
@@ -107,19 +148,87 @@ std::vector<std::pair<std::string, std::string>> CTex::default_regex()
     };
 }
 
-std::string CTex::translate(const std::string& in, EQUATION_TAG_STYLE style)
+CTex::Translation CTex::translate(const std::string& in, EQUATION_TAG_STYLE style)
 {
+    TRACE_SPAN("run", "formula", in);
+    STATS_SCOPE(Translation);
+    STATS_COUNT(Formulas, 1);
+    check_revision();
+    Translation result;
+    std::string text;
+    uint64_t key = 0;
+    DiskCache::Value value;
+    if (disk_cache_ || shared_cache_)
+    {
+        text = str::squeezed(in);
+        key = hash::xxh64(text, cache_seed_.load(std::memory_order_relaxed));
+        bool found = shared_cache_ && shared_cache_->lookup(key, text, value) &&
+                     value.hits.size() == grouped_regs_.size();
+        if (!found && disk_cache_ && disk_cache_->lookup(key, text, value) &&
+            value.hits.size() == grouped_regs_.size())
+        {
+            found = true;
+            if (shared_cache_)
+                shared_cache_->store(key, text, value);
+        }
+        if (found)
+        {
+            for (size_t i = 0; i < grouped_regs_.size(); ++i)
+            {
+                result.hits[grouped_regs_[i].second] = value.hits[i];
+            }
+            result.latex = eq_open_tag(style) + value.latex + eq_close_tag(style);
+            save_hits(result.hits);
+            return result;
+        }
+    }
     // build LaTeX expression
-    std::string result = eq_open_tag(style);
-    auto tokens = lexical_analyzer(in);
-    if (tokens.size())
-        result += translate(tokens);
-    result += eq_close_tag(style);
+    auto tokens = lexical_analyzer(in, result);
+    if (memo_ && tokens.size())
+    {
+        // tokens joined with the unit separator, which can't be a part of a token
+        std::string sequence;
+        for (auto& t : tokens)
+        {
+            sequence += t;
+            sequence += '\x1f';
+        }
+        uint64_t memo_key = hash::xxh64(sequence);
+        if (!memo_->lookup(memo_key, sequence, value.latex))
+        {
+            value.latex = translate(tokens);
+            memo_->store(memo_key, sequence, value.latex);
+        }
+    }
+    else
+    {
+        value.latex = tokens.size() ? translate(tokens) : std::string();
+    }
+    result.latex = eq_open_tag(style) + value.latex + eq_close_tag(style);
+    save_hits(result.hits);
+    if ((disk_cache_ || shared_cache_) && result.diagnostics.empty())
+    {
+        value.hits.clear();
+        for (auto& x : grouped_regs_)
+        {
+            value.hits.push_back(result.hits[x.second]);
+        }
+        if (disk_cache_)
+            disk_cache_->store(key, text, value);
+        if (shared_cache_)
+            shared_cache_->store(key, text, value);
+    }
     return result;
 }
 
+bool CTex::default_grammar() const
+{
+    return default_grammar_;
+}
+
 int CTex::group_hits(const std::string& group)
 {
+    std::lock_guard<std::mutex> lock(hits_lock_);
     if (grouped_hits_.find(group) != grouped_hits_.end())
     {
         return grouped_hits_[group];
@@ -131,6 +240,83 @@ int CTex::group_hits(const std::string& group)
     return 0;
 }
 
+int CTex::Translation::group_hits(const std::string& group) const
+{
+    auto it = hits.find(group);
+    return it != hits.end() ? it->second : 0;
+}
+
+bool CTex::prepare()
+{
+    try {
+        grammar();
+    }
+    catch (std::regex_error& ex)
+    {
+        GLogger::instance().logError(ex.what());
+        return false;
+    }
+    return true;
+}
+
+uint64_t CTex::fingerprint() const
+{
+    std::string grammar = output_version + '\n' + regex_txt_;
+    for (auto& x : grouped_regs_)
+    {
+        grammar += '\n' + x.second;
+    }
+    return hash::xxh64(grammar, LexemeLibrary::fingerprint());
+}
+
+void CTex::set_disk_cache(std::shared_ptr<DiskCache> cache)
+{
+    disk_cache_ = cache;
+    cache_seed_ = fingerprint();
+}
+
+void CTex::set_shared_cache(std::shared_ptr<SharedCache> cache)
+{
+    shared_cache_ = cache;
+    cache_seed_ = fingerprint();
+}
+
+void CTex::check_revision()
+{
+    uint64_t revision = LexemeLibrary::revision();
+    if (revision_.load(std::memory_order_acquire) == revision)
+        return;
+    std::lock_guard<std::mutex> lock(revision_lock_);
+    if (revision_.load(std::memory_order_relaxed) == revision)
+        return;     // updated by another thread
+    // keys and translations made before the library changed are stale
+    if (disk_cache_ || shared_cache_)
+        cache_seed_.store(fingerprint(), std::memory_order_relaxed);
+    if (memo_)
+        memo_->expire(revision);
+    revision_.store(revision, std::memory_order_release);
+}
+
+void CTex::set_memo_capacity(size_t capacity)
+{
+    if (capacity)
+        memo_ = std::make_shared<LruCache<std::string>>(capacity);
+    else
+        memo_.reset();
+}
+
+CTex::MemoStats CTex::memo_stats() const
+{
+    MemoStats stats = { 0, 0, 0 };
+    if (memo_)
+    {
+        stats.hits = memo_->hits();
+        stats.misses = memo_->misses();
+        stats.size = memo_->size();
+    }
+    return stats;
+}
+
 //-------------------------------------------------------------------//
 // Private methods
 //-------------------------------------------------------------------//
@@ -143,73 +329,88 @@ std::string CTex::translate(const std::vector<std::string>& tokens)
     int level = 0;
     int pos = 0;
     //------------------------------------------------------------------
-    for (auto& t : tokens)
     {
-        Lexeme l(t, pos);
-        do
+        STATS_SCOPE(Sorting);
+        for (auto& t : tokens)
         {
-            if (l.type() == LexemeLibrary::bracketl) {
-                ++level;
-                tr.save_parenthesis_pos(l);
-                break;
-            }
-            if (l.type() == LexemeLibrary::bracketr) {
-                --level;
-                tr.save_parenthesis_pos(l);
-                break;
-            }
-                
-            if (LexemeLibrary::is_toperator(l.type()))
+            Lexeme l(t, pos);
+            do
             {
-                l.update_priority(level);
-                toperators.push_back(l);
-            }
-            else
-            {
-                lexemes.push_back(l);
-            }
-        }while(false);
-        ++pos;
+                if (l.type() == LexemeLibrary::bracketl) {
+                    ++level;
+                    tr.save_parenthesis_pos(l);
+                    break;
+                }
+                if (l.type() == LexemeLibrary::bracketr) {
+                    --level;
+                    tr.save_parenthesis_pos(l);
+                    break;
+                }
+                    
+                if (LexemeLibrary::is_toperator(l.type()))
+                {
+                    l.update_priority(level);
+                    toperators.push_back(l);
+                }
+                else
+                {
+                    lexemes.push_back(l);
+                }
+            }while(false);
+            ++pos;
+        }
+        
+        // sort operators by priority
+        std::sort(toperators.rbegin(), toperators.rend(),
+                  [&](const Lexeme& l1, const Lexeme&l2) -> bool {
+                      return l1.priority() < l2.priority();
+                  });
     }
-    
-    // sort operators by priority
-    std::sort(toperators.rbegin(), toperators.rend(),
-              [&](const Lexeme& l1, const Lexeme&l2) -> bool {
-                  return l1.priority() < l2.priority();
-              });
-    GLogger::instance().logTrace("Operation list (sort by priority):"_i18n);
+    GLOG_TRACE("Operation list (sort by priority):"_i18n);
     for(auto& lex : toperators)
     {
-        GLogger::instance().logTrace("\t", lex.lexeme(), " with priority: "_i18n, lex.priority(), " and pos: "_i18n, lex.pos());
+        GLOG_TRACE("\t", lex.lexeme(), " with priority: "_i18n, lex.priority(), " and pos: "_i18n, lex.pos());
     }
-    GLogger::instance().logTrace("Other lexemes list (sort by position):"_i18n);
+    GLOG_TRACE("Other lexemes list (sort by position):"_i18n);
     for(auto& lex : lexemes)
     {
-        GLogger::instance().logTrace("\t", lex.lexeme(), " with pos: "_i18n, lex.pos());
+        GLOG_TRACE("\t", lex.lexeme(), " with pos: "_i18n, lex.pos());
     };
     
     // I pass - fill with transform operators
-    for(auto& op: toperators)
     {
-        tr.insert(op);
+        STATS_SCOPE(TreeBuilding);
+        for(auto& op: toperators)
+        {
+            tr.insert(op);
+        }
     }
-    GLogger::instance().logTrace("I. Operation tree (sort by position):"_i18n);
+    GLOG_TRACE("I. Operation tree (sort by position):"_i18n);
     tr.output();
-    GLogger::instance().logDebug(tr.display());
+    GLOG_DEBUG([&]() { return tr.display(); });
     
     // II pass - fill with lexemes
-    for(auto& lex: lexemes)
     {
-        tr.insert(lex);
+        STATS_SCOPE(TreeBuilding);
+        for(auto& lex: lexemes)
+        {
+            tr.insert(lex);
+        }
     }
-    GLogger::instance().logTrace("II. Final tree (sort by position):"_i18n);
+    GLOG_TRACE("II. Final tree (sort by position):"_i18n);
     tr.output();
-    GLogger::instance().logDebug(tr.display());
+    GLOG_DEBUG([&]() { return tr.display(); });
     //
-    GLogger::instance().logTrace("Appling transformations:"_i18n);
+    GLOG_TRACE("Appling transformations:"_i18n);
     return tr.transform();	// apply transformation
 }
 
+void CTex::save_hits(const std::unordered_map<std::string, int>& hits)
+{
+    std::lock_guard<std::mutex> lock(hits_lock_);
+    grouped_hits_ = hits;
+}
+
 size_t CTex::match_index(std::sregex_iterator it)
 {
     size_t index = 0;
@@ -222,35 +423,49 @@ size_t CTex::match_index(std::sregex_iterator it)
     return index;
 }
 
-std::vector<std::string> CTex::lexical_analyzer(const std::string& in)
+std::vector<std::string> CTex::lexical_analyzer(const std::string& in, Translation& result)
 {
+    STATS_SCOPE(Lexing);
     std::vector<std::string> tokens;
-    grouped_hits_.clear();
+    for (auto& d : grouped_regs_)
+    {
+        result.hits[d.second] = 0;
+    }
     try {
-        std::regex re(regex_txt_);
-        auto begin = std::sregex_iterator(in.begin(), in.end(), re);
+        auto re = grammar();
+        auto begin = std::sregex_iterator(in.begin(), in.end(), *re);
         auto end  = std::sregex_iterator();
         for (auto it = begin; it != end; ++it)
         {
             size_t index = match_index(it);
             auto group = grouped_regs_[index].second;
-            GLogger::instance().logDebug("\t", it->str(), "\t", group);
-            ++grouped_hits_[group];
+            GLOG_DEBUG("\t", [&]() { return it->str(); }, "\t", group);
+            ++result.hits[group];
             tokens.push_back(it->str());
         }
     }
     catch (std::regex_error& ex)
     {
         GLogger::instance().logError(ex.what());
+        result.diagnostics.push_back(ex.what());
     }
-    GLogger::instance().logDebug("Statistics:"_i18n);
-    for (auto& d : grouped_hits_)
+    GLOG_DEBUG("Statistics:"_i18n);
+    for (auto& d : result.hits)
     {
-        GLogger::instance().logDebug("\t", d.first, "\t", d.second);
+        GLOG_DEBUG("\t", d.first, "\t", d.second);
     }
+    STATS_COUNT(Tokens, tokens.size());
     return tokens;
 }
 
+std::shared_ptr<const std::regex> CTex::grammar()
+{
+    std::lock_guard<std::mutex> lock(grammar_lock_);
+    if (!grammar_)
+        grammar_ = std::make_shared<const std::regex>(regex_txt_);
+    return grammar_;
+}
+
 std::string CTex::eq_open_tag(CTex::EQUATION_TAG_STYLE style)
 {
     switch (style) {
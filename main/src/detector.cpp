@@ -10,18 +10,209 @@
 #include "utils.hpp"
 #include "glogger.hpp"
 #include "i18n.hpp"
+#include "fileio.hpp"
+#include "hash.hpp"
+#include "trace.hpp"
+
+#include <cstring>
+#include <sstream>
+#include <algorithm>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const std::string block_open = "/** CTEX";  ///< first line of generated comment block
+    const std::string block_close = "*/";       ///< last line of generated comment block
+    const std::string format_version = "ctex-detector-1";   ///< version of the output layout
+}
 
 Detector::Detector(std::shared_ptr<CTex> ctex) :
+Detector(Factory())
+{
+    ctex_ = ctex;
+}
+
+Detector::Detector(Factory factory) :
 min_op_count_(0)
 , min_fn_count_(0)
-, ctex_(ctex)
+, factory_(factory)
+, prefilter_(false)
 { }
 
-void Detector::perform(std::ifstream& in, std::ofstream& out)
+void Detector::init_prefilter() const
+{
+    prefilter_ = ctex_->default_grammar();
+    if (!prefilter_)
+        return;     // group hits of a custom grammar can't be estimated
+    for (auto& op : LexemeLibrary::get_lexemes(LexemeLibrary::operation))
+    {
+        for (auto c : op)
+        {
+            if (op_chars_.find(c) == std::string::npos)
+                op_chars_.push_back(c);
+        }
+    }
+    for (auto& fn : LexemeLibrary::get_lexemes(LexemeLibrary::function))
+    {
+        if (!fn.empty())
+            functions_[fn.front()].push_back(fn);
+    }
+}
+
+void Detector::perform(std::istream& in, std::ostream& stream)
+{
+    std::string text;
+    {
+        STATS_SCOPE(Input);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        text = ss.str();
+    }
+    Writer out(stream);
+    perform(text.data(), text.size(), out);
+    out.flush();
+}
+
+bool Detector::perform(const std::string& in_filename, const std::string& out_filename)
+{
+    TRACE_SPAN("run", "file", in_filename);
+    MappedFile in(in_filename);
+    if (!in.good())
+        return false;
+    Manifest::Entry entry = { 0, 0, 0 };
+    if (manifest_)
+    {
+        Manifest::Entry prev;
+        entry.input_hash = hash::xxh64(in.data(), in.size());
+        entry.fingerprint = fingerprint();
+        if (manifest_->find(in_filename, prev) &&
+            prev.input_hash == entry.input_hash &&
+            prev.fingerprint == entry.fingerprint)
+        {
+            MappedFile out(out_filename);
+            if (out.good() && hash::xxh64(out.data(), out.size()) == prev.output_hash)
+                return true;    // up to date
+        }
+    }
+    if (!write_file(in, in_filename, out_filename))
+        return false;
+    if (manifest_)
+    {
+        MappedFile out(out_filename);
+        entry.output_hash = hash::xxh64(out.data(), out.size());
+        manifest_->update(in_filename, entry);
+    }
+    return true;
+}
+
+bool Detector::perform(const std::string& in_filename, Writer& out)
+{
+    TRACE_SPAN("run", "file", in_filename);
+    MappedFile in(in_filename);
+    if (!in.good())
+        return false;
+    perform(in.data(), in.size(), out);
+    out.flush();
+    return out.good();
+}
+
+bool Detector::write_file(const MappedFile& in, const std::string& in_filename, const std::string& out_filename)
+{
+    if (fileio::same_file(in_filename, out_filename))
+    {
+        // truncating the output would truncate the mapped input
+        std::ostringstream stream;
+        {
+            Writer out(stream);
+            perform(in.data(), in.size(), out);
+        }
+        const std::string result = stream.str();
+        return fileio::replace(out_filename, result.data(), result.size());
+    }
+#ifndef _WIN32
+    int fd = ::open(out_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+    Writer out(fd);
+    perform(in.data(), in.size(), out);
+    out.flush();
+    bool ok = out.good();
+    ok = (::close(fd) == 0) && ok;
+    return ok;
+#else
+    std::ofstream stream(out_filename, std::ios::out | std::ios::binary);
+    if (!stream.good())
+        return false;
+    Writer out(stream);
+    perform(in.data(), in.size(), out);
+    out.flush();
+    return out.good();
+#endif
+}
+
+bool Detector::perform_in_place(const std::string& filename, bool& changed)
+{
+    TRACE_SPAN("run", "file", filename);
+    changed = false;
+    MappedFile in(filename);
+    if (!in.good())
+        return false;
+    Manifest::Entry entry = { 0, 0, 0 };
+    if (manifest_)
+    {
+        Manifest::Entry prev;
+        entry.input_hash = hash::xxh64(in.data(), in.size());
+        entry.fingerprint = fingerprint();
+        if (manifest_->find(filename, prev) &&
+            prev.fingerprint == entry.fingerprint &&
+            prev.output_hash == entry.input_hash)
+        {
+            return true;    // file is the output of the previous run
+        }
+    }
+    std::ostringstream stream;
+    {
+        Writer out(stream);
+        perform(in.data(), in.size(), out);
+    }
+    const std::string result = stream.str();
+    changed = result.size() != in.size() || !std::equal(result.begin(), result.end(), in.data());
+    if (changed && !fileio::replace(filename, result.data(), result.size()))
+        return false;
+    if (manifest_)
+    {
+        entry.output_hash = changed ? hash::xxh64(result) : entry.input_hash;
+        manifest_->update(filename, entry);
+    }
+    return true;
+}
+
+void Detector::perform(const char* data, size_t size, Writer& out)
 {
+    STATS_COUNT(Files, 1);
+    STATS_COUNT(InputBytes, size);
+    scan(data, size, &out, nullptr);
+}
+
+std::vector<Detector::Statement> Detector::statements(const char* data, size_t size)
+{
+    std::vector<Statement> found;
+    scan(data, size, nullptr, &found);
+    return found;
+}
+
+void Detector::scan(const char* data, size_t size, Writer* out, std::vector<Statement>* found)
+{
+    STATS_SCOPE(Detection);
     bool in_formula = false;
     bool in_comment = false;
     bool skip = false;
+    bool modified = false;
     static const std::string oc = "/*";
     static const std::string cc = "*/";
     static const std::string ic = "//";
@@ -29,17 +220,65 @@ void Detector::perform(std::ifstream& in, std::ofstream& out)
     std::string::size_type pos_cc;
     std::string formula;
     std::string line;
+    const char* const end = data + size;
+    const char* line_begin = nullptr;
+    const char* line_end = nullptr;
+    const char* formula_begin = nullptr; // first line of the formula in the input
+    bool formula_verbatim = false;       // formula is a single unchanged line
+    const char* block_begin = nullptr;   // previously generated block, waiting for its formula
+    size_t block_size = 0;
+    std::string block_input;             // formula stored in the block
+    std::string block_header;            // first line of the block
+    std::string header;                  // first line of new blocks, built with the grammar
+    auto current_header = [&]() -> const std::string& {
+        if (header.empty())
+            header = block_open + " <!-- " + hash::to_hex(fingerprint()) + " -->";
+        return header;
+    };
+    const char* counted = data;          // line numbers are counted up to this position
+    size_t counted_lines = 0;
     
     auto should_skip = [](const std::string& line) -> bool
     {
         return line.empty() || line == " " || line == "\t";
     };
-
+    // write input span as is, terminate it with a new line if the input has no one
+    auto write_span = [&](const char* begin) {
+        if (!out)
+            return;
+        out->write_ref(begin, line_end - begin);
+        if (*(line_end - 1) != '\n')
+            *out << '\n';
+    };
+    auto write_line = [&](const std::string& text) {
+        if (out)
+            *out << text << '\n';
+    };
     
-    for (;!in.eof() && getline(in, line);)
+    for (const char* next = data; next < end;)
     {
+        line_begin = next;
+        const char* eol = static_cast<const char*>(std::memchr(line_begin, '\n', end - line_begin));
+        line_end = eol ? eol + 1 : end;
+        next = line_end;
+        line.assign(line_begin, eol ? eol : end);
+        
+        // keep previously generated block aside until the formula it describes
+        if (!in_comment && !in_formula)
+        {
+            const char* block_end = nullptr;
+            if (find_block(line_begin, end, block_end, block_header, block_input))
+            {
+                block_begin = line_begin;
+                block_size = block_end - line_begin;
+                next = block_end;
+                continue;
+            }
+        }
+        
         // erase comments
         skip = false;
+        modified = false;
         do
         {
             pos_oc = line.find(oc);
@@ -47,6 +286,7 @@ void Detector::perform(std::ifstream& in, std::ofstream& out)
             if (pos_oc != std::string::npos ||
                 pos_cc != std::string::npos)
             {
+                modified = true;
                 // `.../*`  `.../* */...`
                 while (pos_oc != std::string::npos ||
                        pos_cc != std::string::npos)
@@ -81,6 +321,7 @@ void Detector::perform(std::ifstream& in, std::ofstream& out)
             else if (line.find(ic) != std::string::npos)
             {	
                 // `...//`
+                modified = true;
                 line = line.substr(0, line.find(ic));
                 skip = should_skip(line);
             }
@@ -91,7 +332,11 @@ void Detector::perform(std::ifstream& in, std::ofstream& out)
         {
             if (str::find(line, "if") || str::find(line, "else"))
             {
-                out << line << std::endl;
+                if (modified)
+                    write_line(line);
+                else
+                    write_span(line_begin);
+                block_begin = nullptr;
                 continue;
             }
             
@@ -101,10 +346,28 @@ void Detector::perform(std::ifstream& in, std::ofstream& out)
             }
             
             if (in_formula) {
+                formula_verbatim = formula.empty() ? !modified : false;
+                if (formula.empty())
+                    formula_begin = line_begin;
                 formula.append(line);
                 if (str::find(formula, ";")) {
-                    process(formula, out);
-                    out << formula << std::endl;
+                    if (found)
+                    {
+                        counted_lines += std::count(counted, formula_begin, '\n');
+                        counted = formula_begin;
+                        size_t lines = std::count(formula_begin, line_end, '\n') + (*(line_end - 1) != '\n');
+                        found->push_back({ counted_lines, lines, formula });
+                    }
+                    // the block is reused, if neither the formula nor the settings changed
+                    if (out && block_begin && block_input == formula && block_header == current_header())
+                        out->write_ref(block_begin, block_size);
+                    else if (out)
+                        process(formula, current_header(), *out);
+                    block_begin = nullptr;
+                    if (formula_verbatim)
+                        write_span(formula_begin);
+                    else
+                        write_line(formula);
                     in_formula = false;
                     formula = std::string();
                 }
@@ -112,7 +375,11 @@ void Detector::perform(std::ifstream& in, std::ofstream& out)
             }
         }
         
-        out << line << std::endl;
+        if (modified)
+            write_line(line);
+        else
+            write_span(line_begin);
+        block_begin = nullptr;  // stale block is dropped
     }
 }
 
@@ -122,21 +389,129 @@ void Detector::set_filter(int min_op_count, int min_fn_count)
     min_fn_count_ = min_fn_count;
 }
 
-void Detector::process(const std::string& formula, std::ofstream& stream)
+void Detector::set_manifest(std::shared_ptr<Manifest> manifest)
+{
+    manifest_ = manifest;
+}
+
+uint64_t Detector::fingerprint() const
+{
+    std::ostringstream ss;
+    ss << format_version << ' ' << min_op_count_ << ' ' << min_fn_count_;
+    return hash::xxh64(ss.str(), translator().fingerprint());
+}
+
+bool Detector::translate(const std::string& formula, CTex::EQUATION_TAG_STYLE style, CTex::Translation& result)
 {
-    static const std::string id = "CTEX";
-    std::string res, log;
-    GLogger::instance().start_record();
-    GLogger::instance().logInfo("Input: "_i18n, formula);
-    res = ctex_->translate(formula);
-    GLogger::instance().logInfo("Output:"_i18n, res, "\n");
-    log = GLogger::instance().end_record();
+    if (!may_pass_filter(formula))
+        return false;
+    result = translator().translate(formula, style);
     // apply filter
-    if (ctex_->group_hits("operator") > min_op_count_ ||
-        ctex_->group_hits("function") > min_fn_count_)
+    return result.group_hits("operator") > min_op_count_ ||
+           result.group_hits("function") > min_fn_count_;
+}
+
+void Detector::process(const std::string& formula, const std::string& header, Writer& stream)
+{
+    CTex::Translation res;
+    if (translate(formula, CTex::DOXYFILE, res))
     {
-        stream << std::endl << "/** " << id << std::endl;
-        stream << log;
-        stream << "*/" << std::endl;
+        STATS_SCOPE(Formatting);
+        stream << '\n' << header << '\n';
+        stream << "Input: "_i18n << formula << '\n';
+        for (auto& d : res.diagnostics)
+        {
+            stream << d << '\n';
+        }
+        stream << "Output:"_i18n << res.latex << '\n' << '\n';
+        stream << block_close << '\n';
     }
 }
+
+bool Detector::may_pass_filter(const std::string& formula) const
+{
+    translator();   // the check depends on the grammar
+    if (!prefilter_)
+        return true;
+    int op_count = 0;
+    for (auto c : formula)
+    {
+        if (op_chars_.find(c) != std::string::npos && ++op_count > min_op_count_)
+            return true;
+    }
+    int fn_count = 0;
+    for (std::string::size_type i = 0; i < formula.size(); ++i)
+    {
+        auto it = functions_.find(formula[i]);
+        if (it == functions_.end())
+            continue;
+        for (auto& fn : it->second)
+        {
+            if (formula.compare(i, fn.size(), fn) == 0)
+            {
+                if (++fn_count > min_fn_count_)
+                    return true;
+                break;
+            }
+        }
+    }
+    return false;
+}
+
+bool Detector::find_block(const char* begin, const char* end, const char*& block_end,
+                          std::string& block_header, std::string& input) const
+{
+    static const std::string input_prefix = "Input: "_i18n;
+    // cheap check: the block starts with an empty line or with the header
+    const char* p = begin;
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        ++p;
+    if (p < end && *p != '\n' && *p != '/')
+        return false;
+    
+    bool header = false;
+    bool has_input = false;
+    std::string line;
+    for (const char* next = begin; next < end;)
+    {
+        const char* eol = static_cast<const char*>(std::memchr(next, '\n', end - next));
+        const bool first = next == begin;
+        line.assign(next, eol ? eol : end);
+        next = eol ? eol + 1 : end;
+        if (!header)
+        {
+            // the header may follow an empty line, that separates the block
+            str::trim(line);
+            if (line == block_open || str::starts_with(line, block_open + ' '))
+            {
+                header = true;
+                block_header = line;
+            }
+            else if (!first || !line.empty())
+                return false;
+            continue;
+        }
+        if (!has_input && str::starts_with(line, input_prefix))
+        {
+            // formula is stored as is, including trailing whitespaces
+            input = line.substr(input_prefix.size());
+            has_input = true;
+        }
+        else if (str::trimmed(line) == block_close)
+        {
+            block_end = next;
+            return has_input;
+        }
+    }
+    return false;
+}
+
+CTex& Detector::translator() const
+{
+    std::call_once(ctex_once_, [this]() {
+        if (!ctex_)
+            ctex_ = factory_();
+        init_prefilter();
+    });
+    return *ctex_;
+}
@@ -0,0 +1,336 @@
+/**
+ * @file diskcache.cpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief Persistent cache of formula translations
+ */
+
+#include "diskcache.hpp"
+#include "glogger.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const char magic[8] = { 'C', 'T', 'E', 'X', 'D', 'C', '0', '1' };
+    const uint32_t byte_order_mark = 0x01020304;
+    
+    /**
+     * @brief File header
+     */
+    struct Header
+    {
+        char magic[8];
+        uint32_t byte_order;
+        uint32_t count;
+        uint64_t generation;
+        uint64_t data_size;
+    };
+    
+    const size_t index_entry_size = 24;
+    
+    template<typename T>
+    T read(const char* p)
+    {
+        T v;
+        std::memcpy(&v, p, sizeof(T));
+        return v;
+    }
+    
+    template<typename T>
+    void append(std::string& s, T v)
+    {
+        s.append(reinterpret_cast<const char*>(&v), sizeof(T));
+    }
+    
+    /**
+     * @brief Validate header of a mapped cache file
+     */
+    bool parse(const MappedFile& file, Header& h)
+    {
+        if (file.size() < sizeof(Header))
+            return false;
+        std::memcpy(&h, file.data(), sizeof(Header));
+        return !std::memcmp(h.magic, magic, sizeof(magic)) && h.byte_order == byte_order_mark &&
+            sizeof(Header) + h.count * index_entry_size + h.data_size == file.size();
+    }
+    
+    /**
+     * @brief Exclusive advisory lock of "<file>.lock", serializes concurrent saves
+     */
+    class SaveLock
+    {
+    public:
+        explicit SaveLock(const std::string& filename) : fd_(-1)
+        {
+#ifndef _WIN32
+            fd_ = ::open((filename + ".lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if (fd_ >= 0 && ::flock(fd_, LOCK_EX) != 0)
+            {
+                ::close(fd_);
+                fd_ = -1;
+            }
+#endif
+        }
+        ~SaveLock()
+        {
+#ifndef _WIN32
+            if (fd_ >= 0)
+                ::close(fd_);   // releases the lock
+#endif
+        }
+        SaveLock(const SaveLock&) = delete;
+        SaveLock& operator=(const SaveLock&) = delete;
+    private:
+        int fd_;
+    };
+}
+
+DiskCache::DiskCache(size_t max_size) :
+max_size_(max_size)
+, index_(nullptr)
+, data_(nullptr)
+, count_(0)
+, data_size_(0)
+, generation_(1)
+{ }
+
+bool DiskCache::open(const std::string& filename)
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    filename_ = filename;
+    used_.clear();
+    added_.clear();
+    count_ = 0;
+    data_size_ = 0;
+    generation_ = 1;
+    if (!file_.open(filename))
+        return true;    // no cache yet
+    
+    Header h;
+    if (!parse(file_, h))
+    {
+        GLogger::instance().logWarn("Ignoring malformed cache file: ", filename);
+        file_.close();
+        return false;
+    }
+    count_ = h.count;
+    data_size_ = static_cast<size_t>(h.data_size);
+    generation_ = h.generation + 1;
+    index_ = file_.data() + sizeof(Header);
+    data_ = index_ + count_ * index_entry_size;
+    return true;
+}
+
+bool DiskCache::save()
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    if (filename_.empty())
+        return false;
+    if (added_.empty() && used_.empty())
+        return true;    // nothing to write back
+    
+    // merge with the current file, other runs may have saved since open
+    SaveLock save_lock(filename_);
+    std::unordered_map<uint64_t, uint64_t> used;
+    for (auto& u : used_)
+    {
+        used[read<uint64_t>(index_ + u.first * index_entry_size)] = u.second;
+    }
+    MappedFile current;
+    Header h;
+    size_t count = 0;
+    const char* index = nullptr;
+    const char* data = nullptr;
+    uint64_t generation = generation_;
+    if (current.open(filename_) && parse(current, h))
+    {
+        count = h.count;
+        index = current.data() + sizeof(Header);
+        data = index + count * index_entry_size;
+        generation = std::max(generation, static_cast<uint64_t>(h.generation));
+    }
+    
+    // collect all entries: { generation, key, record }
+    struct Item
+    {
+        uint64_t generation;
+        uint64_t key;
+        const char* data;
+        size_t size;
+    };
+    std::vector<Item> items;
+    items.reserve(count + added_.size());
+    for (size_t i = 0; i < count; ++i)
+    {
+        const char* e = index + i * index_entry_size;
+        uint64_t key = read<uint64_t>(e);
+        uint32_t offset = read<uint32_t>(e + 16);
+        uint32_t size = read<uint32_t>(e + 20);
+        if (added_.count(key) || offset + size > h.data_size)
+            continue;
+        uint64_t last = read<uint64_t>(e + 8);
+        auto u = used.find(key);
+        if (u != used.end())
+            last = std::max(last, u->second);
+        items.push_back({ last, key, data + offset, size });
+    }
+    for (auto& a : added_)
+    {
+        items.push_back({ generation, a.first, a.second.data(), a.second.size() });
+    }
+    
+    // evict least recently used entries
+    std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) {
+        return a.generation > b.generation;
+    });
+    size_t total = 0;
+    size_t keep = 0;
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        if (total + items[i].size <= max_size_)
+        {
+            total += items[i].size;
+            items[keep++] = items[i];
+        }
+    }
+    items.resize(keep);
+    std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) {
+        return a.key < b.key;
+    });
+    
+    std::string content;
+    content.reserve(sizeof(Header) + items.size() * index_entry_size + total);
+    std::memcpy(h.magic, magic, sizeof(magic));
+    h.byte_order = byte_order_mark;
+    h.count = static_cast<uint32_t>(items.size());
+    h.generation = generation;
+    h.data_size = total;
+    content.append(reinterpret_cast<const char*>(&h), sizeof(Header));
+    uint32_t offset = 0;
+    for (auto& item : items)
+    {
+        append<uint64_t>(content, item.key);
+        append<uint64_t>(content, item.generation);
+        append<uint32_t>(content, offset);
+        append<uint32_t>(content, static_cast<uint32_t>(item.size));
+        offset += static_cast<uint32_t>(item.size);
+    }
+    for (auto& item : items)
+    {
+        content.append(item.data, item.size);
+    }
+    return fileio::replace(filename_, content.data(), content.size());
+}
+
+bool DiskCache::lookup(uint64_t key, const std::string& text, Value& value)
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    auto it = added_.find(key);
+    if (it != added_.end())
+    {
+        return unpack(it->second.data(), it->second.size(), text, value);
+    }
+    long i = find_mapped(key);
+    if (i < 0)
+        return false;
+    const char* e = index_ + i * index_entry_size;
+    uint32_t offset = read<uint32_t>(e + 16);
+    uint32_t size = read<uint32_t>(e + 20);
+    if (offset + size > data_size_ || !unpack(data_ + offset, size, text, value))
+        return false;
+    used_[static_cast<size_t>(i)] = generation_;
+    return true;
+}
+
+void DiskCache::store(uint64_t key, const std::string& text, const Value& value)
+{
+    std::string record = pack(text, value);
+    std::lock_guard<std::mutex> lock(lock_);
+    added_[key] = std::move(record);
+}
+
+size_t DiskCache::size() const
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    return count_ + added_.size();
+}
+
+std::string DiskCache::pack(const std::string& text, const Value& value)
+{
+    // { text size, text, hits count, hits, latex size, latex }
+    std::string record;
+    record.reserve(12 + text.size() + value.hits.size() * 4 + value.latex.size());
+    append<uint32_t>(record, static_cast<uint32_t>(text.size()));
+    record.append(text);
+    append<uint32_t>(record, static_cast<uint32_t>(value.hits.size()));
+    for (auto h : value.hits)
+    {
+        append<int32_t>(record, h);
+    }
+    append<uint32_t>(record, static_cast<uint32_t>(value.latex.size()));
+    record.append(value.latex);
+    return record;
+}
+
+bool DiskCache::unpack(const char* data, size_t size, const std::string& text, Value& value)
+{
+    const char* p = data;
+    const char* const end = data + size;
+    auto take = [&](size_t n) -> const char* {
+        if (static_cast<size_t>(end - p) < n)
+            return nullptr;
+        const char* r = p;
+        p += n;
+        return r;
+    };
+    const char* f = take(4);
+    if (!f)
+        return false;
+    uint32_t text_size = read<uint32_t>(f);
+    f = take(text_size);
+    if (!f || text_size != text.size() || text.compare(0, text_size, f, text_size))
+        return false;
+    if (!(f = take(4)))
+        return false;
+    uint32_t hits = read<uint32_t>(f);
+    if (!(f = take(size_t(hits) * 4)))
+        return false;
+    value.hits.resize(hits);
+    for (uint32_t i = 0; i < hits; ++i)
+    {
+        value.hits[i] = read<int32_t>(f + i * 4);
+    }
+    if (!(f = take(4)))
+        return false;
+    uint32_t latex_size = read<uint32_t>(f);
+    if (!(f = take(latex_size)))
+        return false;
+    value.latex.assign(f, latex_size);
+    return true;
+}
+
+long DiskCache::find_mapped(uint64_t key) const
+{
+    size_t lo = 0, hi = count_;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        uint64_t k = read<uint64_t>(index_ + mid * index_entry_size);
+        if (k < key)
+            lo = mid + 1;
+        else if (k > key)
+            hi = mid;
+        else
+            return static_cast<long>(mid);
+    }
+    return -1;
+}
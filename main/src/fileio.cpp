@@ -0,0 +1,193 @@
+/**
+ * @file fileio.cpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief File access helpers
+ */
+
+#include "fileio.hpp"
+#include "stats.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cerrno>
+#include <cstdlib>
+#include <atomic>
+#include <string>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() :
+data_(nullptr)
+, size_(0)
+, mapped_(false)
+, good_(false)
+{ }
+
+MappedFile::MappedFile(const std::string& filename) :
+MappedFile()
+{
+    open(filename);
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const std::string& filename)
+{
+    STATS_SCOPE(Input);
+    close();
+#ifndef _WIN32
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+    {
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ == 0)
+        {
+            good_ = true;
+        }
+        else
+        {
+            void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                data_ = static_cast<const char*>(p);
+                mapped_ = good_ = true;
+            }
+        }
+    }
+    ::close(fd);
+    if (good_)
+        return true;
+    size_ = 0;
+#endif
+    // fall back to reading
+    std::ifstream in(filename, std::ios::in | std::ios::binary);
+    if (!in.good())
+        return false;
+    std::stringstream ss;
+    ss << in.rdbuf();
+    content_ = ss.str();
+    data_ = content_.data();
+    size_ = content_.size();
+    good_ = true;
+    return true;
+}
+
+void MappedFile::close()
+{
+#ifndef _WIN32
+    if (mapped_)
+    {
+        munmap(const_cast<char*>(data_), size_);
+    }
+#endif
+    content_.clear();
+    data_ = nullptr;
+    size_ = 0;
+    mapped_ = false;
+    good_ = false;
+}
+
+bool MappedFile::good() const
+{
+    return good_;
+}
+
+const char* MappedFile::data() const
+{
+    return data_;
+}
+
+size_t MappedFile::size() const
+{
+    return size_;
+}
+
+bool fileio::replace(const std::string& filename, const char* data, size_t size)
+{
+    STATS_SCOPE(Output);
+    STATS_COUNT(OutputBytes, size);
+#ifndef _WIN32
+    // replace the target of a symbolic link, not the link itself
+    std::string target = filename;
+    if (char* resolved = ::realpath(filename.c_str(), nullptr))
+    {
+        target = resolved;
+        std::free(resolved);
+    }
+    // unique name instead of mkstemp: O_CREAT lets the kernel apply umask
+    // to the 0666 mode, without changing the process-wide umask
+    static std::atomic<unsigned> counter(0);
+    std::string tmpname;
+    int fd = -1;
+    for (int attempt = 0; fd < 0 && attempt < 100; ++attempt)
+    {
+        tmpname = target + ".ctex-" + std::to_string(::getpid()) + "-" + std::to_string(counter++);
+        fd = ::open(tmpname.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+        if (fd < 0 && errno != EEXIST)
+            return false;
+    }
+    if (fd < 0)
+        return false;
+    bool ok = true;
+    struct stat st;
+    if (stat(target.c_str(), &st) == 0)
+    {
+        struct stat tmp;
+        if (fstat(fd, &tmp) != 0)
+            ok = false;
+        else if (tmp.st_uid != st.st_uid || tmp.st_gid != st.st_gid)
+            ok = fchown(fd, st.st_uid, st.st_gid) == 0;
+        ok = ok && fchmod(fd, st.st_mode & 07777) == 0;
+    }
+    for (size_t written = 0; ok && written < size;)
+    {
+        ssize_t n = ::write(fd, data + written, size - written);
+        if (n < 0 && errno == EINTR)
+            continue;
+        ok = n > 0;
+        if (ok)
+            written += static_cast<size_t>(n);
+    }
+    // the content must reach the disk before the rename, otherwise a crash
+    // may leave an empty file in place of the source
+    ok = ok && ::fsync(fd) == 0;
+    ok = (::close(fd) == 0) && ok;
+    ok = ok && std::rename(tmpname.c_str(), target.c_str()) == 0;
+    if (!ok)
+    {
+        std::remove(tmpname.c_str());
+    }
+    return ok;
+#else
+    // rename can't replace existing file on Windows, so fall back to rewriting
+    std::ofstream out(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    out.write(data, size);
+    return out.good();
+#endif
+}
+
+bool fileio::same_file(const std::string& first, const std::string& second)
+{
+#ifndef _WIN32
+    struct stat a, b;
+    return stat(first.c_str(), &a) == 0 && stat(second.c_str(), &b) == 0 &&
+           a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+#else
+    // a mapped file can't be truncated on Windows, opening the output fails instead
+    return false;
+#endif
+}
@@ -0,0 +1,10 @@
+/**
+ * @file glogger.cpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief GLogger implementation, compiled once into the library
+ */
+
+#define __glogger_implementation__
+#include "glogger.hpp"
@@ -0,0 +1,135 @@
+/**
+ * @file hash.cpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief Fast non-cryptographic hashing
+ */
+
+#include "hash.hpp"
+
+namespace
+{
+    const uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+    const uint64_t prime3 = 0x165667B19E3779F9ULL;
+    const uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+    const uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+    
+    inline uint64_t rotl(uint64_t x, int r)
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+    
+    inline uint64_t read64(const unsigned char* p)
+    {
+        uint64_t v = 0;
+        for (int i = 7; i >= 0; --i)
+            v = (v << 8) | p[i];
+        return v;
+    }
+    
+    inline uint32_t read32(const unsigned char* p)
+    {
+        return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+    }
+    
+    inline uint64_t round(uint64_t acc, uint64_t input)
+    {
+        acc += input * prime2;
+        acc = rotl(acc, 31);
+        return acc * prime1;
+    }
+    
+    inline uint64_t merge_round(uint64_t acc, uint64_t val)
+    {
+        acc ^= round(0, val);
+        return acc * prime1 + prime4;
+    }
+}
+
+uint64_t hash::xxh64(const void* data, size_t size, uint64_t seed)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const unsigned char* const end = p + size;
+    uint64_t h;
+    
+    if (size >= 32)
+    {
+        const unsigned char* const limit = end - 32;
+        uint64_t v1 = seed + prime1 + prime2;
+        uint64_t v2 = seed + prime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - prime1;
+        do
+        {
+            v1 = round(v1, read64(p)); p += 8;
+            v2 = round(v2, read64(p)); p += 8;
+            v3 = round(v3, read64(p)); p += 8;
+            v4 = round(v4, read64(p)); p += 8;
+        } while (p <= limit);
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = merge_round(h, v1);
+        h = merge_round(h, v2);
+        h = merge_round(h, v3);
+        h = merge_round(h, v4);
+    }
+    else
+    {
+        h = seed + prime5;
+    }
+    
+    h += static_cast<uint64_t>(size);
+    
+    for (; p + 8 <= end; p += 8)
+    {
+        h ^= round(0, read64(p));
+        h = rotl(h, 27) * prime1 + prime4;
+    }
+    if (p + 4 <= end)
+    {
+        h ^= static_cast<uint64_t>(read32(p)) * prime1;
+        h = rotl(h, 23) * prime2 + prime3;
+        p += 4;
+    }
+    for (; p < end; ++p)
+    {
+        h ^= (*p) * prime5;
+        h = rotl(h, 11) * prime1;
+    }
+    
+    // avalanche
+    h ^= h >> 33;
+    h *= prime2;
+    h ^= h >> 29;
+    h *= prime3;
+    h ^= h >> 32;
+    return h;
+}
+
+std::string hash::to_hex(uint64_t value)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string text(16, '0');
+    for (int i = 15; i >= 0; --i, value >>= 4)
+    {
+        text[i] = digits[value & 0xf];
+    }
+    return text;
+}
+
+bool hash::from_hex(const std::string& text, uint64_t& value)
+{
+    if (text.size() != 16)
+        return false;
+    value = 0;
+    for (auto c : text)
+    {
+        int d;
+        if (c >= '0' && c <= '9') d = c - '0';
+        else if (c >= 'a' && c <= 'f') d = c - 'a' + 10;
+        else return false;
+        value = (value << 4) | static_cast<uint64_t>(d);
+    }
+    return true;
+}
@@ -0,0 +1,479 @@
+/**
+ * @file json.cpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief Minimal JSON value for line based protocols
+ */
+
+#include "json.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+
+namespace json
+{
+    /**
+     * @brief Recursive descent parser
+     */
+    class Value::Parser
+    {
+    public:
+        explicit Parser(const std::string& text) :
+        p_(text.data())
+        , end_(text.data() + text.size())
+        , depth_(0)
+        { }
+
+        bool parse(Value& value)
+        {
+            return parse_value(value) && (skip(), p_ == end_);
+        }
+    private:
+        /**
+         * @brief Nesting limit, protects the stack from malicious input
+         */
+        static const int max_depth = 256;
+
+        void skip()
+        {
+            while (p_ != end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r'))
+                ++p_;
+        }
+
+        bool literal(const char* word)
+        {
+            const char* p = p_;
+            for (; *word; ++word, ++p)
+            {
+                if (p == end_ || *p != *word)
+                    return false;
+            }
+            p_ = p;
+            return true;
+        }
+
+        bool parse_value(Value& value)
+        {
+            skip();
+            if (p_ == end_)
+                return false;
+            switch (*p_)
+            {
+                case 'n': value = Value(); return literal("null");
+                case 't': value = Value(true); return literal("true");
+                case 'f': value = Value(false); return literal("false");
+                case '"': value = Value(std::string()); return parse_string(value.string_);
+                case '[': return parse_array(value);
+                case '{': return parse_object(value);
+                default: return parse_number(value);
+            }
+        }
+
+        bool parse_number(Value& value)
+        {
+            const char* begin = p_;
+            if (p_ != end_ && *p_ == '-')
+                ++p_;
+            const char* digits = p_;
+            while (p_ != end_ && ((*p_ >= '0' && *p_ <= '9') || *p_ == '.' ||
+                                  *p_ == 'e' || *p_ == 'E' || *p_ == '+' || *p_ == '-'))
+                ++p_;
+            if (p_ == digits || *digits < '0' || *digits > '9')
+                return false;
+            std::string number(begin, p_);
+            char* stop = nullptr;
+            double v = std::strtod(number.c_str(), &stop);
+            if (*stop)
+                return false;
+            value = Value(v);
+            return true;
+        }
+
+        bool parse_hex(uint32_t& code)
+        {
+            if (end_ - p_ < 4)
+                return false;
+            code = 0;
+            for (int i = 0; i < 4; ++i, ++p_)
+            {
+                char c = *p_;
+                code <<= 4;
+                if (c >= '0' && c <= '9') code |= c - '0';
+                else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+                else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+                else return false;
+            }
+            return true;
+        }
+
+        static void append_utf8(uint32_t code, std::string& out)
+        {
+            if (code < 0x80)
+            {
+                out += static_cast<char>(code);
+            }
+            else if (code < 0x800)
+            {
+                out += static_cast<char>(0xC0 | (code >> 6));
+                out += static_cast<char>(0x80 | (code & 0x3F));
+            }
+            else if (code < 0x10000)
+            {
+                out += static_cast<char>(0xE0 | (code >> 12));
+                out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (code & 0x3F));
+            }
+            else
+            {
+                out += static_cast<char>(0xF0 | (code >> 18));
+                out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+                out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (code & 0x3F));
+            }
+        }
+
+        bool parse_string(std::string& out)
+        {
+            ++p_;   // opening quote
+            while (p_ != end_)
+            {
+                char c = *p_++;
+                if (c == '"')
+                    return true;
+                if (static_cast<unsigned char>(c) < 0x20)
+                    return false;
+                if (c != '\\')
+                {
+                    out += c;
+                    continue;
+                }
+                if (p_ == end_)
+                    return false;
+                switch (*p_++)
+                {
+                    case '"': out += '"'; break;
+                    case '\\': out += '\\'; break;
+                    case '/': out += '/'; break;
+                    case 'b': out += '\b'; break;
+                    case 'f': out += '\f'; break;
+                    case 'n': out += '\n'; break;
+                    case 'r': out += '\r'; break;
+                    case 't': out += '\t'; break;
+                    case 'u':
+                    {
+                        uint32_t code = 0;
+                        if (!parse_hex(code))
+                            return false;
+                        if (code >= 0xD800 && code < 0xDC00)
+                        {
+                            // surrogate pair
+                            uint32_t low = 0;
+                            if (!literal("\\u") || !parse_hex(low) || low < 0xDC00 || low > 0xDFFF)
+                                return false;
+                            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        }
+                        append_utf8(code, out);
+                        break;
+                    }
+                    default:
+                        return false;
+                }
+            }
+            return false;
+        }
+
+        bool parse_array(Value& value)
+        {
+            if (++depth_ > max_depth)
+                return false;
+            ++p_;
+            value = Value::array();
+            skip();
+            if (p_ != end_ && *p_ == ']')
+            {
+                ++p_;
+                --depth_;
+                return true;
+            }
+            while (true)
+            {
+                Value item;
+                if (!parse_value(item))
+                    return false;
+                value.items_.push_back(std::move(item));
+                skip();
+                if (p_ == end_)
+                    return false;
+                char c = *p_++;
+                if (c == ']')
+                    break;
+                if (c != ',')
+                    return false;
+            }
+            --depth_;
+            return true;
+        }
+
+        bool parse_object(Value& value)
+        {
+            if (++depth_ > max_depth)
+                return false;
+            ++p_;
+            value = Value::object();
+            skip();
+            if (p_ != end_ && *p_ == '}')
+            {
+                ++p_;
+                --depth_;
+                return true;
+            }
+            while (true)
+            {
+                std::string key;
+                Value member;
+                skip();
+                if (p_ == end_ || *p_ != '"' || !parse_string(key))
+                    return false;
+                skip();
+                if (p_ == end_ || *p_++ != ':')
+                    return false;
+                if (!parse_value(member))
+                    return false;
+                value.set(key, member);
+                skip();
+                if (p_ == end_)
+                    return false;
+                char c = *p_++;
+                if (c == '}')
+                    break;
+                if (c != ',')
+                    return false;
+            }
+            --depth_;
+            return true;
+        }
+    private:
+        const char* p_;         ///< @brief current position
+        const char* end_;       ///< @brief end of the text
+        int depth_;             ///< @brief current nesting level
+    };
+
+    Value::Value() :
+    type_(Null)
+    , bool_(false)
+    , number_(0)
+    { }
+
+    Value::Value(bool value) :
+    type_(Boolean)
+    , bool_(value)
+    , number_(0)
+    { }
+
+    Value::Value(int value) :
+    type_(Number)
+    , bool_(false)
+    , number_(value)
+    { }
+
+    Value::Value(double value) :
+    type_(Number)
+    , bool_(false)
+    , number_(value)
+    { }
+
+    Value::Value(const char* value) :
+    type_(String)
+    , bool_(false)
+    , number_(0)
+    , string_(value)
+    { }
+
+    Value::Value(const std::string& value) :
+    type_(String)
+    , bool_(false)
+    , number_(0)
+    , string_(value)
+    { }
+
+    Value Value::array()
+    {
+        Value v;
+        v.type_ = Array;
+        return v;
+    }
+
+    Value Value::object()
+    {
+        Value v;
+        v.type_ = Object;
+        return v;
+    }
+
+    bool Value::parse(const std::string& text, Value& value)
+    {
+        Parser parser(text);
+        return parser.parse(value);
+    }
+
+    Value::Type Value::type() const { return type_; }
+    bool Value::is_null() const { return type_ == Null; }
+    bool Value::is_number() const { return type_ == Number; }
+    bool Value::is_string() const { return type_ == String; }
+    bool Value::is_array() const { return type_ == Array; }
+    bool Value::is_object() const { return type_ == Object; }
+
+    bool Value::as_bool() const
+    {
+        return type_ == Boolean && bool_;
+    }
+
+    double Value::as_number() const
+    {
+        return type_ == Number ? number_ : 0;
+    }
+
+    const std::string& Value::as_string() const
+    {
+        static const std::string empty;
+        return type_ == String ? string_ : empty;
+    }
+
+    const std::vector<Value>& Value::items() const
+    {
+        return items_;
+    }
+
+    void Value::push(const Value& item)
+    {
+        if (type_ != Array)
+            *this = array();
+        items_.push_back(item);
+    }
+
+    const Value& Value::operator[](const std::string& key) const
+    {
+        static const Value null;
+        for (auto& m : members_)
+        {
+            if (m.first == key)
+                return m.second;
+        }
+        return null;
+    }
+
+    bool Value::has(const std::string& key) const
+    {
+        for (auto& m : members_)
+        {
+            if (m.first == key)
+                return true;
+        }
+        return false;
+    }
+
+    Value& Value::set(const std::string& key, const Value& value)
+    {
+        if (type_ != Object)
+            *this = object();
+        for (auto& m : members_)
+        {
+            if (m.first == key)
+            {
+                m.second = value;
+                return *this;
+            }
+        }
+        members_.emplace_back(key, value);
+        return *this;
+    }
+
+    std::string Value::dump() const
+    {
+        std::string out;
+        dump(out);
+        return out;
+    }
+
+    void Value::dump(std::string& out) const
+    {
+        switch (type_)
+        {
+            case Null:
+                out += "null";
+                break;
+            case Boolean:
+                out += bool_ ? "true" : "false";
+                break;
+            case Number:
+            {
+                char buf[32];
+                if (!std::isfinite(number_))
+                    out += "null";
+                else if (number_ == std::floor(number_) && std::fabs(number_) < 1e15)
+                    out.append(buf, std::snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(number_)));
+                else
+                    out.append(buf, std::snprintf(buf, sizeof(buf), "%.17g", number_));
+                break;
+            }
+            case String:
+                quote(string_, out);
+                break;
+            case Array:
+                out += '[';
+                for (size_t i = 0; i < items_.size(); ++i)
+                {
+                    if (i)
+                        out += ',';
+                    items_[i].dump(out);
+                }
+                out += ']';
+                break;
+            case Object:
+                out += '{';
+                for (size_t i = 0; i < members_.size(); ++i)
+                {
+                    if (i)
+                        out += ',';
+                    quote(members_[i].first, out);
+                    out += ':';
+                    members_[i].second.dump(out);
+                }
+                out += '}';
+                break;
+        }
+    }
+
+    void quote(const std::string& text, std::string& out)
+    {
+        static const char hex[] = "0123456789abcdef";
+        out += '"';
+        for (char c : text)
+        {
+            switch (c)
+            {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20)
+                    {
+                        out += "\\u00";
+                        out += hex[(c >> 4) & 0xF];
+                        out += hex[c & 0xF];
+                    }
+                    else
+                    {
+                        out += c;
+                    }
+                    break;
+            }
+        }
+        out += '"';
+    }
+}
@@ -8,12 +8,16 @@
 #include "lexeme.hpp"
 #include "glogger.hpp"
 #include "utils.hpp"
+#include "hash.hpp"
 
 #include <iostream>
 #include <sstream>
 #include <algorithm>
+#include <iterator>
+#include <mutex>
 
 int LexemeLibrary::max_priority = 5;
+std::atomic<uint64_t> LexemeLibrary::revision_(0);
 
 std::vector<LexemeLibrary::LexData> LexemeLibrary::lex_library {
     // brackets
@@ -241,6 +245,28 @@ void LexemeLibrary::add_lexeme(const std::string& lex, Type type, int priority)
                                          LexData(std::pair<std::string,
                                                  std::pair<Type, int>>(lex, std::pair<Type, int>(type, priority)))
                                          );
+    revision_.fetch_add(1, std::memory_order_release);
+}
+
+bool LexemeLibrary::remove_lexeme(const std::string& lex)
+{
+    // the last one, so the lexeme added latest is removed
+    auto it = std::find_if(lex_library.rbegin(), lex_library.rend(), [&lex](const LexData& lex_data) {
+        return lex_data.first == lex;
+    });
+    if (it == lex_library.rend())
+        return false;
+    lex_library.erase(std::next(it).base());
+    revision_.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+void LexemeLibrary::add_extensions()
+{
+    static std::once_flag once;
+    std::call_once(once, []() {
+        add_lexeme("fsign", function, 1);
+    });
 }
 
 std::vector<std::string> LexemeLibrary::get_lexemes(Type type)
@@ -287,6 +313,17 @@ int LexemeLibrary::get_priority(const std::string& lex)
     return -1;
 }
 
+uint64_t LexemeLibrary::fingerprint()
+{
+    std::stringstream ss;
+    ss << max_priority << '\n';
+    for (auto& lex_data : LexemeLibrary::lex_library)
+    {
+        ss << lex_data.first << '\t' << lex_data.second.first << '\t' << lex_data.second.second << '\n';
+    }
+    return hash::xxh64(ss.str());
+}
+
 Lexeme::Lexeme() :
 position_(-1)
 , priority_(0)
@@ -358,3 +395,8 @@ bool Lexeme::operator< (const Lexeme& lex) const {
 bool Lexeme::operator> (const Lexeme& lex) const {
     return (priority_ > lex.priority_) || (priority_ == lex.priority_ && position_ < lex.position_);
 }
+
+uint64_t LexemeLibrary::revision()
+{
+    return revision_.load(std::memory_order_acquire);
+}
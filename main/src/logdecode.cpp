@@ -0,0 +1,32 @@
+/**
+ * @file logdecode.cpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief Renders binary GLogger logs (`ctex --binary-log`) as text
+ */
+
+#include <iostream>
+#include <fstream>
+
+#include "glogger.hpp"
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2) {
+        std::cout << "Usage:\n"
+            << "ctex_logdecode <binary.log> > text.log" << std::endl;
+        return 1;
+    }
+    std::ifstream in(argv[1], std::ios::in | std::ios::binary);
+    if (!in.good()) {
+        std::cerr << "Bad file: " << argv[1] << std::endl;
+        return 1;
+    }
+    std::ios::sync_with_stdio(false);
+    if (!GLogger::decode_binary(in, std::cout)) {
+        std::cerr << "Damaged binary log: " << argv[1] << std::endl;
+        return 1;
+    }
+    return 0;
+}
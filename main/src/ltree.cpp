@@ -8,6 +8,7 @@
 #include "ltree.hpp"
 #include "glogger.hpp"
 #include "processing.hpp"
+#include "stats.hpp"
 
 #include <algorithm>
 
@@ -18,6 +19,7 @@ LexemeTree::LexemeTree()
 
 std::string LexemeTree::transform()
 {
+    STATS_SCOPE(Transform);
     if (!root_)
         return std::string();
     std::string res = transform(root_);
@@ -74,7 +76,8 @@ std::string LexemeTree::display()
 
 void LexemeTree::output()
 {
-    output(root_);
+    if (GLogger::instance().enabled(GLogger::Trace))
+        output(root_);
 }
 
 std::string LexemeTree::transform(const std::unique_ptr<TreeNode> &node)
@@ -87,7 +90,7 @@ std::string LexemeTree::transform(const std::unique_ptr<TreeNode> &node)
         
         Lexeme& lex = node->data;
         
-        GLogger::instance().logTrace("\t", lex.lexeme(), " ", (node->left ? node->left->data.lexeme() : ""), " ", (node->right ? node->right->data.lexeme() : ""));
+        GLOG_TRACE("\t", lex.lexeme(), " ", (node->left ? node->left->data.lexeme() : ""), " ", (node->right ? node->right->data.lexeme() : ""));
         
         if (!LexemeLibrary::is_toperator( lex.type() ))
         {
@@ -136,7 +139,7 @@ void LexemeTree::output(const std::unique_ptr<TreeNode> &node)
         return;
     
     output(node->left);
-    GLogger::instance().logTrace("\t", node->data.lexeme(), " pos: ", node->data.pos(), " priority: ", node->data.priority());
+    GLOG_TRACE("\t", node->data.lexeme(), " pos: ", node->data.pos(), " priority: ", node->data.priority());
     output(node->right);
 }
 
@@ -4,39 +4,349 @@
 
 #include <iostream>
 #include <string>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <sstream>
+#include <csignal>
+#include <exception>
 
 #include "ctex.hpp"
 #include "detector.hpp"
-#define __glogger_implementation__
+#include "service.hpp"
+#include "batch.hpp"
+#include "preview.hpp"
 #include "glogger.hpp"
+#include "trace.hpp"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace
+{
+	Service* running_service = nullptr;
+
+	/**
+	 * @brief Memo size of the daemon, unless set by --memo
+	 */
+	const size_t daemon_memo_capacity = 1 << 16;
+
+	void stop_service(int)
+	{
+		if (running_service)
+			running_service->stop();
+	}
+
+	std::terminate_handler default_terminate = nullptr;
+
+	void dump_log()
+	{
+		// context of an uncaught exception
+		GLogger::instance().dump_flight_recorder();
+		if (default_terminate)
+			default_terminate();
+		std::abort();
+	}
+
+	/**
+	 * @brief Finishes the trace file and writes stats to stderr, when main returns
+	 */
+	struct RunReport
+	{
+		bool stats = false;
+		bool json = false;
+		std::string trace_file;
+		~RunReport()
+		{
+			if (!trace_file.empty() && !trace::stop())
+				std::cerr << "Failed to write trace: " << trace_file << std::endl;
+			if (stats)
+				stats::report(std::cerr, json);
+		}
+	};
+}
 
 int main(int argc, char* argv[])
 {
 	bool interactive = false;
-	if (argc == 2 && !strcmp(argv[1], "-i")) {
-		interactive = true;
+	bool in_place = false;
+	bool filter = false;
+	bool batch = false;
+	bool serve = false;
+	Batch::Format batch_format = Batch::Lines;
+	std::string manifest_file;
+	std::string cache_file;
+	std::string shared_cache_file;
+	std::string binary_log_file;
+	size_t memo_capacity = 0;
+	size_t flight_records = 0;
+	std::string daemon_socket;
+	std::string client_socket;
+	size_t threads = 0;
+	std::vector<std::string> files;
+	RunReport report;	// first constructed, so it is written last
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-i")) {
+			interactive = true;
+		}
+		else if (!strcmp(argv[i], "--in-place")) {
+			in_place = true;
+		}
+		else if (!strcmp(argv[i], "--filter")) {
+			filter = true;
+		}
+		else if (!strcmp(argv[i], "--serve")) {
+			serve = true;
+		}
+		else if (!strcmp(argv[i], "--batch")) {
+			batch = true;
+		}
+		else if (!strcmp(argv[i], "--jsonl")) {
+			batch = true;
+			batch_format = Batch::JsonLines;
+		}
+		else if (!strcmp(argv[i], "--manifest") && i + 1 < argc) {
+			manifest_file = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--cache") && i + 1 < argc) {
+			cache_file = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--shm-cache") && i + 1 < argc) {
+			shared_cache_file = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--binary-log") && i + 1 < argc) {
+			binary_log_file = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--flight-recorder") && i + 1 < argc) {
+			flight_records = std::strtoul(argv[++i], nullptr, 10);
+		}
+		else if (!strcmp(argv[i], "--memo") && i + 1 < argc) {
+			memo_capacity = std::strtoul(argv[++i], nullptr, 10);
+		}
+		else if (!strcmp(argv[i], "--daemon") && i + 1 < argc) {
+			daemon_socket = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--client") && i + 1 < argc) {
+			client_socket = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--stats")) {
+			report.stats = true;
+		}
+		else if (!strcmp(argv[i], "--stats-json")) {
+			report.stats = true;
+			report.json = true;
+		}
+		else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+			report.trace_file = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+			threads = std::strtoul(argv[++i], nullptr, 10);
+		}
+		else {
+			files.push_back(argv[i]);
+		}
 	}
 
-	if (!interactive && argc < 3) {
-		std::cout << "Usage:"
-			<< "ctex.exe <in_file.c> <out_file.c>" << std::endl;
+	bool valid = false;
+	if (interactive || batch || serve || !daemon_socket.empty())
+		valid = true;
+	else if (!client_socket.empty())
+		valid = files.size() <= 1;
+	else if (in_place)
+		valid = !files.empty();
+	else
+		valid = files.size() == (filter ? 1u : 2u);
+	if (!valid) {
+		std::cout << "Usage:\n"
+			<< "ctex.exe [options] <in_file.c> <out_file.c>\n"
+			<< "ctex.exe [options] --in-place <file.c>...\n"
+			<< "ctex.exe [options] --filter <file.c>\n"
+			<< "ctex.exe [options] --daemon <socket>\n"
+			<< "ctex.exe --client <socket> [<file.c>]\n"
+			<< "ctex.exe [options] -i\n"
+			<< "ctex.exe [options] --batch [--jsonl] < formulas > results\n"
+			<< "ctex.exe [options] --serve\n"
+			<< "Options:\n"
+			<< "  --manifest <file>  skip files, that did not change since the previous run\n"
+			<< "  --cache <file>     persistent cache of translations\n"
+			<< "  --shm-cache <file> share translations with concurrent ctex processes\n"
+			<< "  --memo <entries>   memorize up to <entries> translations in memory,\n"
+			<< "                     65536 by default with --daemon\n"
+			<< "  --binary-log <file> compact binary log instead of ctex.log, see ctex_logdecode\n"
+			<< "  --flight-recorder <records> keep recent messages of every thread in memory,\n"
+			<< "                     write them to the log on errors and uncaught exceptions\n"
+			<< "  --stats            print time of each stage and counters to stderr at exit\n"
+			<< "  --stats-json       the same as --stats, but as a JSON object\n"
+			<< "  --trace <file>     write Chrome trace events of files, formulas, stages and threads\n"
+			<< "  --jsonl            batch of JSON lines: {\"id\": 1, \"formula\": \"y = x;\"}\n"
+			<< "  -j <threads>       number of worker threads, all hardware threads by default" << std::endl;
 #ifdef _WIN32
 		system("pause");
 #endif
 		exit(1);
 	}
     
+	if ((report.stats || !report.trace_file.empty()) && !stats::compiled()) {
+		std::cerr << "Stats are compiled out, rebuild with -DCTEX_STATS=ON" << std::endl;
+	}
+	if (report.stats) {
+		stats::enable(true);
+	}
+	if (!report.trace_file.empty()) {
+		trace::set_thread_name("main");
+		if (!trace::start(report.trace_file)) {
+			std::cerr << "Failed to create trace: " << report.trace_file << std::endl;
+			report.trace_file.clear();
+		}
+	}
+
+	// thin client: no grammar, no logger, just a round trip to the daemon
+	if (!client_socket.empty())
+	{
+		std::string source;
+		if (files.empty()) {
+			std::stringstream ss;
+			ss << std::cin.rdbuf();
+			source = ss.str();
+		}
+		else {
+			MappedFile in(files[0]);
+			if (!in.good()) {
+				std::cerr << "Bad file: " << files[0] << std::endl;
+				return 1;
+			}
+			source.assign(in.data(), in.size());
+		}
+		std::string error;
+		if (!Service::request(client_socket, source.data(), source.size(), std::cout, &error)) {
+			if (!error.empty())
+				std::cerr << "Service rejected the request: " << error << std::endl;
+			else
+				std::cerr << "Service is not available: " << client_socket << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+	
     // read from cmd or config file
-    GLogger::instance().set_output_mode(GLogger::Output::Both);
-    GLogger::instance().set_min_level(GLogger::Output::Console, GLogger::Level::Info);
-    GLogger::instance().set_min_level(GLogger::Output::File, GLogger::Level::Trace);
-    GLogger::instance().set_log_filename("ctex.log");
+    if (filter || batch || serve) {
+        // stdout is the result, no log file
+        GLogger::instance().set_output_mode(GLogger::Output::Off);
+    }
+    else {
+        GLogger::instance().set_output_mode(GLogger::Output::Both);
+        GLogger::instance().set_min_level(GLogger::Output::Console, GLogger::Level::Info);
+        // a resident service must not trace every request into the log file
+        GLogger::instance().set_min_level(GLogger::Output::File,
+            daemon_socket.empty() ? GLogger::Level::Trace : GLogger::Level::Info);
+        if (binary_log_file.empty())
+            GLogger::instance().set_log_filename("ctex.log");
+        else
+            GLogger::instance().set_binary_log_filename(binary_log_file);
+        if (flight_records) {
+            // trace context without writing trace messages
+            GLogger::instance().set_min_level(GLogger::Output::File, GLogger::Level::Info);
+            GLogger::instance().set_flight_recorder(flight_records);
+            default_terminate = std::set_terminate(dump_log);
+        }
+    }
     
-    LexemeLibrary::add_lexeme("fsign", LexemeLibrary::function, 1);
-    std::shared_ptr<CTex> ctex = std::make_shared<CTex>(CTex::default_regex());
-    Detector detector(ctex);
+    LexemeLibrary::add_extensions();
+    std::shared_ptr<DiskCache> cache;
+    if (!cache_file.empty()) {
+        cache = std::make_shared<DiskCache>();
+        cache->open(cache_file);
+    }
+    std::shared_ptr<SharedCache> shared_cache;
+    if (!shared_cache_file.empty()) {
+        shared_cache = std::make_shared<SharedCache>();
+        if (!shared_cache->open(shared_cache_file))
+            shared_cache.reset();
+    }
+    // the grammar is built only when the first formula is found
+    std::shared_ptr<CTex> ctex;
+    auto make_ctex = [&]() {
+        if (!ctex) {
+            ctex = std::make_shared<CTex>(CTex::default_regex());
+            ctex->set_memo_capacity(memo_capacity);
+            if (cache)
+                ctex->set_disk_cache(cache);
+            if (shared_cache)
+                ctex->set_shared_cache(shared_cache);
+        }
+        return ctex;
+    };
+    Detector detector(make_ctex);
+    std::shared_ptr<Manifest> manifest;
+    if (!manifest_file.empty()) {
+        manifest = std::make_shared<Manifest>();
+        manifest->load(manifest_file);
+        detector.set_manifest(manifest);
+    }
     
-	if (interactive)
+	if (serve)
+	{
+		// editor previews: JSON-RPC on stdin/stdout
+#ifndef _WIN32
+		Writer out(STDOUT_FILENO);
+#else
+		Writer out(std::cout);
+#endif
+		PreviewServer(detector).run(std::cin, out);
+		if (cache)
+			cache->save();
+		return out.good() ? 0 : 1;
+	}
+	if (batch)
+	{
+		// own input buffer, so whole chunks of lines are seen at once
+		std::ios::sync_with_stdio(false);
+#ifndef _WIN32
+		Writer out(STDOUT_FILENO);
+#else
+		Writer out(std::cout);
+#endif
+		Batch(make_ctex(), threads ? threads : 1).run(std::cin, out, batch_format);
+		out.flush();
+		if (cache)
+			cache->save();
+		return out.good() ? 0 : 1;
+	}
+	if (filter)
+	{
+#ifndef _WIN32
+		Writer out(STDOUT_FILENO);
+#else
+		Writer out(std::cout);
+#endif
+		bool ok = detector.perform(files[0], out);
+		if (cache)
+			cache->save();
+		return ok ? 0 : 1;
+	}
+
+	if (!daemon_socket.empty())
+	{
+		// bounded memory for the translations of a long running process
+		if (!memo_capacity)
+			memo_capacity = daemon_memo_capacity;
+		// warm up the grammar before the first request
+		make_ctex()->prepare();
+		Service service(detector, threads);
+		if (!service.listen(daemon_socket))
+			return 1;
+		running_service = &service;
+		std::signal(SIGINT, stop_service);
+		std::signal(SIGTERM, stop_service);
+		// workers never wait for the log file
+		GLogger::instance().start_async(4096, GLogger::Count);
+		service.run();
+		GLogger::instance().stop_async();
+		running_service = nullptr;
+		std::cout << "Done!" << std::endl;
+	}
+	else if (interactive)
 	{
 		std::cout << "> Welcome to interactive CTex.\n Type `exit` to exit." << std::endl;
 		std::string formula;
@@ -47,26 +357,44 @@ int main(int argc, char* argv[])
 			if (!formula.compare("exit"))
 				break;
 			std::cout << "> latex result:" << std::endl;
-			std::cout << ctex->translate(formula) << std::endl;
+			std::cout << make_ctex()->translate(formula).latex << std::endl;
 			std::cout << std::endl;
 		}
 		std::cout << "> Done!" << std::endl;
 	}
-	else
+	else if (in_place)
 	{
-		std::ifstream in_file(argv[1]);
-		std::ofstream out_file(argv[2]);
-
 		std::cout << "Translating..." << std::endl;
-		if (in_file.good() && out_file.good())  {
-			detector.perform(in_file, out_file);
+		int changed_count = 0;
+		for (auto& file : files) {
+			bool changed = false;
+			if (!detector.perform_in_place(file, changed)) {
+				std::cout << "Bad file: " << file << std::endl;
+			}
+			changed_count += changed ? 1 : 0;
 		}
-		else {
+		std::cout << "Done! Files changed: " << changed_count << std::endl;
+	}
+	else
+	{
+		std::cout << "Translating..." << std::endl;
+		if (!detector.perform(files[0], files[1])) {
 			std::cout << "Bad file!" << std::endl;
 		}
 		std::cout << "Done!" << std::endl;
 	}
 
+	if (memo_capacity && ctex) {
+		auto stats = ctex->memo_stats();
+		GLogger::instance().logInfo("Memo hits: ", stats.hits, ", misses: ", stats.misses, ", size: ", stats.size);
+	}
+	if (manifest && !manifest->save(manifest_file)) {
+		std::cout << "Failed to save manifest: " << manifest_file << std::endl;
+	}
+	if (cache && !cache->save()) {
+		std::cout << "Failed to save cache: " << cache_file << std::endl;
+	}
+
 #ifdef _WIN32
 	system("pause");
 #endif
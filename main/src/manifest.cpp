@@ -0,0 +1,100 @@
+/**
+ * @file manifest.cpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief Record of processed files for incremental runs
+ */
+
+#include "manifest.hpp"
+#include "hash.hpp"
+#include "fileio.hpp"
+#include "glogger.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+
+namespace
+{
+    const std::string header = "# ctex manifest 1";
+}
+
+Manifest::Manifest()
+{ }
+
+bool Manifest::load(const std::string& filename)
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    entries_.clear();
+    std::ifstream in(filename);
+    std::string line;
+    if (!in.good() || !std::getline(in, line) || line != header)
+        return false;
+    while (std::getline(in, line))
+    {
+        // <input hash> <fingerprint> <output hash> <path>
+        Entry entry;
+        if (line.size() < 3 * 17 + 1 ||
+            !hash::from_hex(line.substr(0, 16), entry.input_hash) ||
+            !hash::from_hex(line.substr(17, 16), entry.fingerprint) ||
+            !hash::from_hex(line.substr(34, 16), entry.output_hash))
+        {
+            GLogger::instance().logWarn("Malformed manifest entry: ", line);
+            entries_.clear();
+            return false;
+        }
+        entries_[line.substr(51)] = entry;
+    }
+    return true;
+}
+
+bool Manifest::save(const std::string& filename) const
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    // sort by path to keep the file stable between runs
+    std::vector<const std::pair<const std::string, Entry>*> sorted;
+    sorted.reserve(entries_.size());
+    for (auto& e : entries_)
+    {
+        sorted.push_back(&e);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const std::pair<const std::string, Entry>* a,
+                                               const std::pair<const std::string, Entry>* b) {
+        return a->first < b->first;
+    });
+    std::ostringstream ss;
+    ss << header << '\n';
+    for (auto e : sorted)
+    {
+        ss << hash::to_hex(e->second.input_hash) << ' '
+           << hash::to_hex(e->second.fingerprint) << ' '
+           << hash::to_hex(e->second.output_hash) << ' '
+           << e->first << '\n';
+    }
+    const std::string text = ss.str();
+    return fileio::replace(filename, text.data(), text.size());
+}
+
+bool Manifest::find(const std::string& path, Entry& entry) const
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    auto it = entries_.find(path);
+    if (it == entries_.end())
+        return false;
+    entry = it->second;
+    return true;
+}
+
+void Manifest::update(const std::string& path, const Entry& entry)
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    entries_[path] = entry;
+}
+
+size_t Manifest::size() const
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    return entries_.size();
+}
@@ -0,0 +1,344 @@
+/**
+ * @file preview.cpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief JSON-RPC server for live formula previews in editors
+ */
+
+#include "preview.hpp"
+#include "utils.hpp"
+
+#include <deque>
+#include <algorithm>
+
+namespace
+{
+    /**
+     * @brief JSON-RPC error codes
+     */
+    enum ErrorCode
+    {
+        parse_error = -32700,
+        invalid_request = -32600,
+        method_not_found = -32601,
+        invalid_params = -32602
+    };
+
+    /**
+     * @brief Split text into lines, the last line break does not start a new line
+     */
+    std::vector<std::string> split_lines(const std::string& text)
+    {
+        std::vector<std::string> lines;
+        size_t begin = 0;
+        while (begin < text.size())
+        {
+            size_t end = text.find('\n', begin);
+            if (end == std::string::npos)
+                end = text.size();
+            lines.push_back(text.substr(begin, end - begin));
+            begin = end + 1;
+        }
+        return lines;
+    }
+
+    /**
+     * @brief Read non-negative integer parameter
+     */
+    bool get_index(const json::Value& value, size_t& index)
+    {
+        double v = value.as_number();
+        if (!value.is_number() || v < 0 || v != static_cast<double>(static_cast<size_t>(v)))
+            return false;
+        index = static_cast<size_t>(v);
+        return true;
+    }
+}
+
+PreviewServer::PreviewServer(Detector& detector) :
+detector_(detector)
+, next_id_(1)
+, shutdown_(false)
+{ }
+
+void PreviewServer::run(std::istream& in, Writer& out)
+{
+    std::string message;
+    std::string response;
+    while (!shutdown_ && std::getline(in, message))
+    {
+        if (message.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+        handle(message, response);
+        if (!response.empty())
+        {
+            out << response << '\n';
+            out.flush();
+        }
+    }
+}
+
+bool PreviewServer::handle(const std::string& message, std::string& response)
+{
+    response.clear();
+    json::Value request;
+    json::Value reply = json::Value::object();
+    reply.set("jsonrpc", "2.0");
+    int code = 0;
+    std::string error;
+    json::Value result;
+    if (!json::Value::parse(message, request))
+    {
+        code = parse_error;
+        error = "parse error";
+    }
+    else if (!request.is_object() || !request["method"].is_string())
+    {
+        code = invalid_request;
+        error = "invalid request";
+    }
+    else
+    {
+        result = call(request["method"].as_string(), request["params"], code, error);
+        if (!code && !request.has("id"))
+            return !shutdown_;     // notification
+    }
+    reply.set("id", request["id"]);
+    if (code)
+    {
+        json::Value e = json::Value::object();
+        e.set("code", code);
+        e.set("message", error);
+        reply.set("error", e);
+    }
+    else
+    {
+        reply.set("result", result);
+    }
+    response = reply.dump();
+    return !shutdown_;
+}
+
+json::Value PreviewServer::call(const std::string& method, const json::Value& params, int& code, std::string& error)
+{
+    if (method == "shutdown")
+    {
+        shutdown_ = true;
+        return json::Value();
+    }
+    const std::string& uri = params["uri"].as_string();
+    if (method != "open" && method != "change" && method != "close")
+    {
+        code = method_not_found;
+        error = "unknown method: " + method;
+        return json::Value();
+    }
+    if (uri.empty())
+    {
+        code = invalid_params;
+        error = "uri is required";
+        return json::Value();
+    }
+    if (method == "open")
+    {
+        const std::string& style = params["style"].as_string();
+        if (!params["text"].is_string() ||
+            (!style.empty() && style != "doxygen" && style != "display" && style != "inline"))
+        {
+            code = invalid_params;
+            error = "open requires text and known style";
+            return json::Value();
+        }
+        Document& doc = docs_[uri];
+        doc = Document();
+        doc.style = style == "display" ? CTex::DISPLAY : style == "inline" ? CTex::INLINE : CTex::DOXYFILE;
+        doc.lines = split_lines(params["text"].as_string());
+        return update(doc);
+    }
+    auto it = docs_.find(uri);
+    if (it == docs_.end())
+    {
+        code = invalid_params;
+        error = "document is not open: " + uri;
+        return json::Value();
+    }
+    if (method == "close")
+    {
+        docs_.erase(it);
+        return json::Value();
+    }
+    // change
+    Document& doc = it->second;
+    if (params["text"].is_string())
+    {
+        doc.lines = split_lines(params["text"].as_string());
+        doc.head = doc.tail = 0;
+    }
+    else if (params["edits"].is_array())
+    {
+        // validate all edits first, so a bad request leaves the document untouched
+        Document edited = doc;
+        for (auto& e : params["edits"].items())
+        {
+            size_t start = 0, end = 0;
+            if (!get_index(e["start"], start) || !get_index(e["end"], end) ||
+                !e["text"].is_string() || !edit(edited, start, end, e["text"].as_string()))
+            {
+                code = invalid_params;
+                error = "invalid edit";
+                return json::Value();
+            }
+        }
+        doc.lines.swap(edited.lines);
+        doc.head = edited.head;
+        doc.tail = edited.tail;
+    }
+    else
+    {
+        code = invalid_params;
+        error = "change requires edits or text";
+        return json::Value();
+    }
+    return update(doc);
+}
+
+bool PreviewServer::edit(Document& doc, size_t start, size_t end, const std::string& text)
+{
+    if (start > end || end > doc.lines.size())
+        return false;
+    auto lines = split_lines(text);
+    doc.head = std::min(doc.head, start);
+    doc.tail = std::min(doc.tail, doc.lines.size() - end);
+    doc.lines.erase(doc.lines.begin() + start, doc.lines.begin() + end);
+    doc.lines.insert(doc.lines.begin() + start, lines.begin(), lines.end());
+    return true;
+}
+
+json::Value PreviewServer::update(Document& doc)
+{
+    // lines [head, size - tail) changed, the following ones shifted by delta
+    const size_t size = doc.lines.size();
+    const size_t old_end = doc.scanned - doc.tail;
+    const long delta = static_cast<long>(size) - static_cast<long>(doc.scanned);
+    auto shifted = [&](const Entry& e) -> size_t {
+        return static_cast<size_t>(static_cast<long>(e.line) + delta);
+    };
+    // entries [begin, end) are scanned again: the changed ones and a statement on each side,
+    // that must be found again to prove, that the scan starts and ends outside of a statement
+    const size_t count = doc.entries.size();
+    size_t first = 0;
+    while (first < count && doc.entries[first].line + doc.entries[first].lines <= doc.head)
+        ++first;
+    size_t last = first;
+    while (last < count && doc.entries[last].line < old_end)
+        ++last;
+    const bool before = first > 0;
+    const bool after = last < count;
+    size_t begin = before ? first - 1 : 0;
+    size_t end = after ? last + 1 : count;
+    size_t from = before ? doc.entries[begin].line : 0;
+    size_t to = after ? shifted(doc.entries[last]) + doc.entries[last].lines : size;
+
+    auto scan = [&]() {
+        std::string text;
+        for (size_t i = from; i < to; ++i)
+        {
+            text += doc.lines[i];
+            text += '\n';
+        }
+        auto found = detector_.statements(text.data(), text.size());
+        for (auto& s : found)
+            s.line += from;
+        return found;
+    };
+    auto same = [&](const Detector::Statement& s, const Entry& e, size_t line) {
+        return s.line == line && str::squeezed(s.formula) == e.key;
+    };
+    auto statements = scan();
+    if ((before && (statements.empty() || !same(statements.front(), doc.entries[begin], from))) ||
+        (after && (statements.empty() || !same(statements.back(), doc.entries[last], shifted(doc.entries[last])))))
+    {
+        from = 0;
+        to = size;
+        begin = 0;
+        end = doc.entries.size();
+        statements = scan();
+    }
+
+    // previous statements by key, in text order
+    std::unordered_map<std::string, std::deque<size_t>> previous;
+    for (size_t i = begin; i < end; ++i)
+    {
+        previous[doc.entries[i].key].push_back(i);
+    }
+    std::vector<bool> kept(doc.entries.size(), false);
+    std::vector<Entry> entries(doc.entries.begin(), doc.entries.begin() + begin);
+    entries.reserve(begin + statements.size() + doc.entries.size() - end);
+    json::Value changed = json::Value::array();
+    json::Value moved = json::Value::array();
+    json::Value removed = json::Value::array();
+    auto move = [&](Entry& entry, size_t line) {
+        if (entry.line == line)
+            return;
+        entry.line = line;
+        if (!entry.shown)
+            return;
+        json::Value m = json::Value::object();
+        m.set("id", static_cast<double>(entry.id));
+        m.set("line", static_cast<double>(entry.line));
+        moved.push(m);
+    };
+    for (auto& s : statements)
+    {
+        std::string key = str::squeezed(s.formula);
+        auto it = previous.find(key);
+        if (it != previous.end() && !it->second.empty())
+        {
+            Entry entry = doc.entries[it->second.front()];
+            kept[it->second.front()] = true;
+            it->second.pop_front();
+            move(entry, s.line);
+            entry.lines = s.lines;
+            entry.input = s.formula;
+            entries.push_back(entry);
+            continue;
+        }
+        Entry entry;
+        entry.id = next_id_++;
+        entry.line = s.line;
+        entry.lines = s.lines;
+        entry.key = key;
+        entry.input = s.formula;
+        CTex::Translation translation;
+        entry.shown = detector_.translate(s.formula, doc.style, translation);
+        entry.latex = translation.latex;
+        if (entry.shown)
+        {
+            json::Value c = json::Value::object();
+            c.set("id", static_cast<double>(entry.id));
+            c.set("line", static_cast<double>(entry.line));
+            c.set("input", entry.input);
+            c.set("latex", entry.latex);
+            changed.push(c);
+        }
+        entries.push_back(entry);
+    }
+    for (size_t i = begin; i < end; ++i)
+    {
+        if (!kept[i] && doc.entries[i].shown)
+            removed.push(static_cast<double>(doc.entries[i].id));
+    }
+    for (size_t i = end; i < doc.entries.size(); ++i)
+    {
+        entries.push_back(doc.entries[i]);
+        move(entries.back(), shifted(doc.entries[i]));
+    }
+    doc.entries.swap(entries);
+    doc.head = doc.tail = doc.scanned = size;
+    json::Value result = json::Value::object();
+    result.set("changed", changed);
+    result.set("moved", moved);
+    result.set("removed", removed);
+    return result;
+}
@@ -0,0 +1,299 @@
+/**
+ * @file service.cpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief Resident translation service on a Unix domain socket
+ */
+
+#include "service.hpp"
+#include "threadpool.hpp"
+#include "writer.hpp"
+#include "glogger.hpp"
+
+#include <cstring>
+#include <cerrno>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    /**
+     * @brief How often run checks for stop request, ms
+     */
+    const int stop_check_interval = 100;
+    /**
+     * @brief Output buffer of one connection
+     */
+    const size_t response_buffer = 64 << 10;
+    /**
+     * @brief How long a worker waits for a silent client, s
+     */
+    const int client_timeout = 10;
+    /**
+     * @brief Largest source a client may send, bytes
+     */
+    const size_t max_request_size = 16 << 20;
+    /**
+     * @brief First byte of an error response, processed source never starts with it
+     */
+    const char error_mark = '\0';
+    
+#ifndef _WIN32
+    /**
+     * @brief Build socket address
+     * @return false if the path is too long
+     */
+    bool make_address(const std::string& socket_path, sockaddr_un& addr)
+    {
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (socket_path.empty() || socket_path.size() >= sizeof(addr.sun_path))
+            return false;
+        std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size());
+        return true;
+    }
+    
+    /**
+     * @brief Connect to the socket
+     * @return connected socket or -1
+     */
+    int connect_to(const std::string& socket_path)
+    {
+        sockaddr_un addr;
+        if (!make_address(socket_path, addr))
+            return -1;
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+        {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+#endif
+}
+
+Service::Service(Detector& detector, size_t threads) :
+detector_(detector)
+, threads_(threads)
+, listen_fd_(-1)
+, stopped_(false)
+{ }
+
+#ifndef _WIN32
+
+Service::~Service()
+{
+    if (listen_fd_ >= 0)
+    {
+        ::close(listen_fd_);
+        ::unlink(socket_path_.c_str());
+    }
+}
+
+bool Service::listen(const std::string& socket_path)
+{
+    sockaddr_un addr;
+    if (!make_address(socket_path, addr))
+    {
+        GLogger::instance().logError("Invalid socket path: ", socket_path);
+        return false;
+    }
+    int running = connect_to(socket_path);
+    if (running >= 0)
+    {
+        ::close(running);
+        GLogger::instance().logError("Service is already running: ", socket_path);
+        return false;
+    }
+    ::unlink(socket_path.c_str());  // left by a service, that was killed
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 ||
+        ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::listen(fd, SOMAXCONN) != 0)
+    {
+        GLogger::instance().logError("Can't listen on socket: ", socket_path, " : ", std::strerror(errno));
+        if (fd >= 0)
+            ::close(fd);
+        return false;
+    }
+    listen_fd_ = fd;
+    socket_path_ = socket_path;
+    return true;
+}
+
+void Service::run()
+{
+    if (listen_fd_ < 0)
+        return;
+    // a client may go away before the response is written
+    ::signal(SIGPIPE, SIG_IGN);
+    ThreadPool pool(threads_);
+    GLogger::instance().logInfo("Serving on ", socket_path_, " with ", pool.size(), " threads");
+    pollfd p = { listen_fd_, POLLIN, 0 };
+    while (!stopped_)
+    {
+        p.revents = 0;
+        int ready = ::poll(&p, 1, stop_check_interval);
+        if (ready <= 0)
+            continue;   // timeout or interrupted by a signal
+        int fd = ::accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0)
+            continue;
+        pool.submit([this, fd]() {
+            serve(fd);
+        });
+    }
+    // pool destructor completes accepted requests
+}
+
+void Service::stop()
+{
+    stopped_ = true;
+}
+
+void Service::serve(int fd)
+{
+    // a client, that neither sends nor reads, must not hold a worker forever
+    timeval timeout = { client_timeout, 0 };
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    std::string source;
+    char chunk[64 << 10];
+    while (true)
+    {
+        ssize_t n = ::read(fd, chunk, sizeof(chunk));
+        if (n > 0)
+        {
+            if (source.size() + static_cast<size_t>(n) > max_request_size)
+            {
+                // don't buffer more of a runaway client, tell why and hang up
+                GLogger::instance().logWarn("Request exceeds ", max_request_size, " bytes, request dropped");
+                Writer out(fd);
+                out.write(&error_mark, 1);
+                std::string error = "request exceeds " + std::to_string(max_request_size) + " bytes";
+                out.write(error.data(), error.size());
+                out.flush();
+                ::close(fd);
+                return;
+            }
+            source.append(chunk, static_cast<size_t>(n));
+        }
+        else if (n == 0)
+            break;
+        else if (errno != EINTR)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                GLogger::instance().logWarn("Client sent no data for ", client_timeout, " s, request dropped");
+            ::close(fd);
+            return;
+        }
+    }
+    {
+        Writer out(fd, response_buffer);
+        detector_.perform(source.data(), source.size(), out);
+        out.flush();
+        if (!out.good())
+            GLogger::instance().logWarn("Client disconnected before the response was sent");
+    }
+    ::close(fd);
+}
+
+bool Service::request(const std::string& socket_path, const char* data, size_t size, std::ostream& out,
+                      std::string* error)
+{
+    int fd = connect_to(socket_path);
+    if (fd < 0)
+        return false;
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+    bool ok = true;
+    for (size_t sent = 0; sent < size;)
+    {
+        ssize_t n = ::send(fd, data + sent, size - sent, flags);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            ok = false;     // the service may have rejected the request, read its reason
+            break;
+        }
+        sent += static_cast<size_t>(n);
+    }
+    ::shutdown(fd, SHUT_WR);
+    char chunk[64 << 10];
+    bool first = true;
+    bool rejected = false;
+    std::string reason;
+    while (true)
+    {
+        ssize_t n = ::read(fd, chunk, sizeof(chunk));
+        if (n > 0)
+        {
+            const char* p = chunk;
+            if (first && chunk[0] == error_mark)
+            {
+                rejected = true;
+                ++p;
+            }
+            first = false;
+            if (rejected)
+                reason.append(p, chunk + n - p);
+            else if (ok)
+                out.write(p, chunk + n - p);
+        }
+        else if (n == 0)
+            break;
+        else if (errno != EINTR)
+        {
+            ok = false;
+            break;
+        }
+    }
+    ::close(fd);
+    if (rejected && error)
+        *error = reason;
+    return ok && !rejected && out.good();
+}
+
+#else
+
+Service::~Service()
+{ }
+
+bool Service::listen(const std::string& socket_path)
+{
+    GLogger::instance().logError("Service is not supported on this platform: ", socket_path);
+    return false;
+}
+
+void Service::run()
+{ }
+
+void Service::stop()
+{
+    stopped_ = true;
+}
+
+void Service::serve(int)
+{ }
+
+bool Service::request(const std::string&, const char*, size_t, std::ostream&, std::string*)
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,278 @@
+/**
+ * @file sharedcache.cpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief Translation cache shared between concurrent processes
+ */
+
+#include "sharedcache.hpp"
+#include "glogger.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <chrono>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const char magic[8] = { 'C', 'T', 'E', 'X', 'S', 'H', 'M', '1' };
+
+    enum State : uint32_t
+    {
+        uninitialized = 0,
+        initializing = 1,
+        ready = 2
+    };
+
+    /**
+     * @brief Longest probe sequence, keeps lookups bounded on a crowded table
+     */
+    const size_t max_probe = 64;
+    /**
+     * @brief Record reference: offset in the upper bits, size in the lower ones
+     */
+    const unsigned size_bits = 24;
+    const uint64_t size_mask = (uint64_t(1) << size_bits) - 1;
+
+    /**
+     * @brief Zero marks an empty slot
+     */
+    inline uint64_t slot_key(uint64_t key)
+    {
+        return key ? key : 1;
+    }
+}
+
+/**
+ * @brief Table header, placed at the beginning of the file
+ */
+struct SharedCache::Header
+{
+    char magic[8];
+    std::atomic<uint32_t> state;
+    uint32_t reserved;
+    uint64_t slot_count;
+    uint64_t capacity;
+    std::atomic<uint64_t> data_used;
+    char padding[24];
+};
+
+/**
+ * @brief Hash table slot
+ */
+struct SharedCache::Slot
+{
+    std::atomic<uint64_t> key;  ///< 0 - empty
+    std::atomic<uint64_t> ref;  ///< 0 - record is not published yet
+};
+
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "atomics must have no extra state");
+
+SharedCache::SharedCache(size_t slots, size_t capacity) :
+slots_(1)
+, capacity_(capacity)
+, map_(nullptr)
+, map_size_(0)
+, header_(nullptr)
+, data_(nullptr)
+{
+    while (slots_ < slots)
+        slots_ <<= 1;
+}
+
+SharedCache::~SharedCache()
+{
+    close();
+}
+
+#ifndef _WIN32
+
+bool SharedCache::open(const std::string& filename)
+{
+    static_assert(sizeof(Header) == 64, "unexpected header layout");
+    static_assert(sizeof(Slot) == 16, "unexpected slot layout");
+    close();
+    if (!std::atomic<uint64_t>().is_lock_free() || !std::atomic<uint32_t>().is_lock_free())
+    {
+        GLogger::instance().logWarn("Shared cache requires lock-free atomics");
+        return false;
+    }
+    int fd = ::open(filename.c_str(), O_RDWR | O_CREAT, 0666);
+    if (fd < 0)
+    {
+        GLogger::instance().logWarn("Can't open shared cache: ", filename);
+        return false;
+    }
+    // grow only: the file may already be in use with another geometry
+    size_t required = sizeof(Header) + slots_ * sizeof(Slot) + capacity_;
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        (static_cast<size_t>(st.st_size) < required && ftruncate(fd, required) != 0) ||
+        fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        GLogger::instance().logWarn("Can't resize shared cache: ", filename);
+        return false;
+    }
+    map_size_ = static_cast<size_t>(st.st_size);
+    void* p = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+    {
+        map_size_ = 0;
+        GLogger::instance().logWarn("Can't map shared cache: ", filename);
+        return false;
+    }
+    map_ = static_cast<char*>(p);
+    header_ = reinterpret_cast<Header*>(map_);
+
+    // the first process initializes the header, the others wait for it
+    uint32_t state = uninitialized;
+    if (header_->state.compare_exchange_strong(state, initializing, std::memory_order_acq_rel))
+    {
+        std::memcpy(header_->magic, magic, sizeof(magic));
+        header_->slot_count = slots_;
+        header_->capacity = capacity_;
+        header_->data_used.store(0, std::memory_order_relaxed);
+        header_->state.store(ready, std::memory_order_release);
+    }
+    else
+    {
+        for (int i = 0; i < 1000 && state != ready; ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            state = header_->state.load(std::memory_order_acquire);
+        }
+    }
+    uint64_t slot_count = header_->slot_count;
+    if (header_->state.load(std::memory_order_acquire) != ready ||
+        std::memcmp(header_->magic, magic, sizeof(magic)) ||
+        !slot_count || (slot_count & (slot_count - 1)) ||
+        sizeof(Header) + slot_count * sizeof(Slot) + header_->capacity > map_size_)
+    {
+        GLogger::instance().logWarn("Ignoring malformed shared cache: ", filename);
+        close();
+        return false;
+    }
+    data_ = map_ + sizeof(Header) + slot_count * sizeof(Slot);
+    return true;
+}
+
+void SharedCache::close()
+{
+    if (map_)
+    {
+        munmap(map_, map_size_);
+    }
+    map_ = nullptr;
+    map_size_ = 0;
+    header_ = nullptr;
+    data_ = nullptr;
+}
+
+#else
+
+bool SharedCache::open(const std::string& filename)
+{
+    GLogger::instance().logWarn("Shared cache is not supported on this platform: ", filename);
+    return false;
+}
+
+void SharedCache::close()
+{ }
+
+#endif
+
+bool SharedCache::good() const
+{
+    return header_ != nullptr;
+}
+
+bool SharedCache::lookup(uint64_t key, const std::string& text, DiskCache::Value& value) const
+{
+    if (!header_)
+        return false;
+    key = slot_key(key);
+    const uint64_t mask = header_->slot_count - 1;
+    for (size_t i = 0; i < max_probe; ++i)
+    {
+        Slot* s = slot((key + i) & mask);
+        uint64_t k = s->key.load(std::memory_order_acquire);
+        if (k == 0)
+            return false;
+        if (k != key)
+            continue;
+        // the record is written before its reference is published
+        uint64_t ref = s->ref.load(std::memory_order_acquire);
+        if (ref == 0)
+            return false;
+        uint64_t offset = ref >> size_bits;
+        uint64_t size = ref & size_mask;
+        if (offset + size > header_->capacity)
+            return false;
+        return DiskCache::unpack(data_ + offset, static_cast<size_t>(size), text, value);
+    }
+    return false;
+}
+
+bool SharedCache::store(uint64_t key, const std::string& text, const DiskCache::Value& value)
+{
+    if (!header_)
+        return false;
+    key = slot_key(key);
+    std::string record = DiskCache::pack(text, value);
+    if (record.size() > size_mask)
+        return false;
+
+    // claim a slot first, so concurrent writers of the same key don't waste data space
+    const uint64_t mask = header_->slot_count - 1;
+    Slot* s = nullptr;
+    for (size_t i = 0; i < max_probe && !s; ++i)
+    {
+        Slot* candidate = slot((key + i) & mask);
+        uint64_t k = candidate->key.load(std::memory_order_acquire);
+        if (k == 0 && candidate->key.compare_exchange_strong(k, key, std::memory_order_acq_rel))
+        {
+            s = candidate;
+        }
+        else if (k == key)
+        {
+            return false;   // stored by someone else
+        }
+    }
+    if (!s)
+        return false;
+
+    uint64_t offset = header_->data_used.fetch_add(record.size(), std::memory_order_relaxed);
+    if (offset + record.size() > header_->capacity)
+        return false;       // slot stays unpublished, lookups treat it as a miss
+    std::memcpy(data_ + offset, record.data(), record.size());
+    s->ref.store(offset << size_bits | record.size(), std::memory_order_release);
+    return true;
+}
+
+size_t SharedCache::size() const
+{
+    if (!header_)
+        return 0;
+    size_t count = 0;
+    for (uint64_t i = 0; i < header_->slot_count; ++i)
+    {
+        if (slot(i)->ref.load(std::memory_order_relaxed))
+            ++count;
+    }
+    return count;
+}
+
+SharedCache::Slot* SharedCache::slot(size_t index) const
+{
+    return reinterpret_cast<Slot*>(map_ + sizeof(Header)) + index;
+}
@@ -0,0 +1,234 @@
+/**
+ * @file stats.cpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief Per-stage timers and counters of a run
+ */
+
+#include "stats.hpp"
+#include "json.hpp"
+#include "trace.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+namespace
+{
+    /**
+     * @brief Slots of one thread, written by the owner only
+     */
+    struct Slots
+    {
+        std::atomic<uint64_t> time[stats::StageCount];
+        std::atomic<uint64_t> calls[stats::StageCount];
+        std::atomic<uint64_t> counters[stats::CounterCount];
+        stats::Timer* current;      ///< innermost running timer
+
+        Slots() :
+        current(nullptr)
+        {
+            for (auto& v : time) v.store(0, std::memory_order_relaxed);
+            for (auto& v : calls) v.store(0, std::memory_order_relaxed);
+            for (auto& v : counters) v.store(0, std::memory_order_relaxed);
+        }
+    };
+
+    /**
+     * @brief Slots of running threads and totals of finished ones
+     */
+    struct Registry
+    {
+        std::mutex lock;
+        std::vector<const Slots*> threads;
+        stats::Snapshot finished;
+        std::atomic<int64_t> enabled_at;
+
+        Registry() :
+        finished()
+        , enabled_at(0)
+        { }
+    };
+
+    Registry& registry()
+    {
+        static Registry r;
+        return r;
+    }
+
+    /**
+     * @brief Single writer increment, cheaper than fetch_add
+     */
+    void bump(std::atomic<uint64_t>& slot, uint64_t n)
+    {
+        slot.store(slot.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    void accumulate(const Slots& slots, stats::Snapshot& s)
+    {
+        for (int i = 0; i < stats::StageCount; ++i)
+        {
+            s.time[i] += slots.time[i].load(std::memory_order_relaxed);
+            s.calls[i] += slots.calls[i].load(std::memory_order_relaxed);
+        }
+        for (int i = 0; i < stats::CounterCount; ++i)
+        {
+            s.counters[i] += slots.counters[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Slots of the calling thread, registered while the thread runs
+     */
+    Slots& local()
+    {
+        struct Holder
+        {
+            Slots slots;
+            Holder()
+            {
+                Registry& r = registry();
+                std::lock_guard<std::mutex> lock(r.lock);
+                r.threads.push_back(&slots);
+            }
+            ~Holder()
+            {
+                Registry& r = registry();
+                std::lock_guard<std::mutex> lock(r.lock);
+                accumulate(slots, r.finished);
+                r.threads.erase(std::find(r.threads.begin(), r.threads.end(), &slots));
+            }
+        };
+        static thread_local Holder holder;
+        return holder.slots;
+    }
+}
+
+namespace stats
+{
+    std::atomic<bool> collecting(false);
+    std::atomic<bool> tracing(false);
+
+    void enable(bool on)
+    {
+        if (!compiled())
+            return;
+        if (on && !collecting.load())
+            registry().enabled_at.store(trace::now());
+        collecting.store(on);
+    }
+
+    const char* stage_name(Stage stage)
+    {
+        static const char* names[] = {"input", "detection", "translation", "lexing", "sorting",
+                                      "tree building", "transform", "formatting", "logging", "output"};
+        return names[stage];
+    }
+
+    const char* counter_name(Counter counter)
+    {
+        static const char* names[] = {"files", "formulas", "tokens", "input bytes", "output bytes"};
+        return names[counter];
+    }
+
+    void add(Counter counter, uint64_t n)
+    {
+        bump(local().counters[counter], n);
+    }
+
+    Snapshot snapshot()
+    {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.lock);
+        Snapshot s = r.finished;
+        for (auto slots : r.threads)
+        {
+            accumulate(*slots, s);
+        }
+        int64_t enabled_at = r.enabled_at.load();
+        s.wall = enabled_at ? static_cast<uint64_t>(trace::now() - enabled_at) : 0;
+        return s;
+    }
+
+    void report(std::ostream& out, bool json)
+    {
+        Snapshot s = snapshot();
+        uint64_t total = 0;
+        for (auto t : s.time)
+            total += t;
+        if (json)
+        {
+            json::Value stages = json::Value::object();
+            for (int i = 0; i < StageCount; ++i)
+            {
+                json::Value stage = json::Value::object();
+                stage.set("calls", static_cast<double>(s.calls[i]));
+                stage.set("us", static_cast<double>(s.time[i] / 1000));
+                stages.set(stage_name(static_cast<Stage>(i)), stage);
+            }
+            json::Value counters = json::Value::object();
+            for (int i = 0; i < CounterCount; ++i)
+            {
+                counters.set(counter_name(static_cast<Counter>(i)), static_cast<double>(s.counters[i]));
+            }
+            json::Value result = json::Value::object();
+            result.set("wall_us", static_cast<double>(s.wall / 1000));
+            result.set("total_us", static_cast<double>(total / 1000));
+            result.set("stages", stages);
+            result.set("counters", counters);
+            out << result.dump() << '\n';
+            return;
+        }
+        char line[128];
+        std::snprintf(line, sizeof(line), "%-14s %12s %12s %7s\n", "stage", "calls", "ms", "share");
+        out << line;
+        for (int i = 0; i < StageCount; ++i)
+        {
+            std::snprintf(line, sizeof(line), "%-14s %12llu %12.3f %6.1f%%\n",
+                          stage_name(static_cast<Stage>(i)),
+                          static_cast<unsigned long long>(s.calls[i]), s.time[i] / 1e6,
+                          total ? 100.0 * s.time[i] / total : 0.0);
+            out << line;
+        }
+        std::snprintf(line, sizeof(line), "%-14s %12s %12.3f\n%-14s %12s %12.3f\n",
+                      "total", "", total / 1e6, "wall", "", s.wall / 1e6);
+        out << line;
+        for (int i = 0; i < CounterCount; ++i)
+        {
+            std::snprintf(line, sizeof(line), "%-14s %12llu\n", counter_name(static_cast<Counter>(i)),
+                          static_cast<unsigned long long>(s.counters[i]));
+            out << line;
+        }
+    }
+
+    void Timer::start(Stage stage)
+    {
+        Slots& slots = local();
+        stage_ = stage;
+        parent_ = slots.current;
+        children_ = 0;
+        slots.current = this;
+        start_ = trace::now();
+    }
+
+    void Timer::stop()
+    {
+        int64_t end = trace::now();
+        int64_t elapsed = end - start_;
+        if (trace::enabled())
+            trace::complete("stage", stage_name(stage_), start_, end, std::string());
+        Slots& slots = local();
+        slots.current = parent_;
+        if (parent_)
+            parent_->children_ += elapsed;
+        if (enabled())
+        {
+            // a timer of a trace-only run records events but no stats
+            bump(slots.time[stage_], static_cast<uint64_t>(elapsed - children_));
+            bump(slots.calls[stage_], 1);
+        }
+    }
+}
@@ -0,0 +1,84 @@
+/**
+ * @file threadpool.cpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief Fixed size pool of worker threads
+ */
+
+#include "threadpool.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threads) :
+active_(0)
+, stopping_(false)
+{
+    if (!threads)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < threads; ++i)
+    {
+        workers_.emplace_back(&ThreadPool::work, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        stopping_ = true;
+    }
+    ready_.notify_all();
+    for (auto& w : workers_)
+    {
+        w.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        tasks_.push_back(std::move(task));
+    }
+    ready_.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(lock_);
+    idle_.wait(lock, [this]() { return tasks_.empty() && !active_; });
+}
+
+size_t ThreadPool::size() const
+{
+    return workers_.size();
+}
+
+void ThreadPool::work()
+{
+    trace::set_thread_name("worker");
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(lock_);
+            ready_.wait(lock, [this]() { return stopping_ || !tasks_.empty(); });
+            if (tasks_.empty())
+                return;     // stopping and nothing left
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+            ++active_;
+        }
+        {
+            TRACE_SPAN("run", "task", std::string());
+            task();
+        }
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            if (--active_ == 0 && tasks_.empty())
+                idle_.notify_all();
+        }
+    }
+}
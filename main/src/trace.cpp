@@ -0,0 +1,225 @@
+/**
+ * @file trace.cpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief Chrome trace events of a run
+ */
+
+#include "trace.hpp"
+#include "json.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+namespace
+{
+    /**
+     * @brief Buffer size, that makes a thread append its events to the file
+     */
+    const size_t flush_size = 64 * 1024;
+
+    /**
+     * @brief Events of one thread
+     * @note Lock order: Output::lock, then Collector::lock
+     */
+    struct Collector
+    {
+        std::mutex lock;
+        std::string events;     ///< formatted events, each ends with ",\n"
+        std::string name;       ///< thread name
+        uint64_t tid;           ///< thread id in the trace
+    };
+
+    /**
+     * @brief Trace file and collectors of running threads
+     */
+    struct Output
+    {
+        std::mutex lock;
+        std::ofstream file;
+        std::vector<Collector*> threads;
+        std::atomic<int64_t> origin;    ///< start time, ns
+        uint64_t next_tid;
+
+        Output() :
+        origin(0)
+        , next_tid(1)
+        { }
+    };
+
+    Output& output()
+    {
+        static Output o;
+        return o;
+    }
+
+    /**
+     * @brief Write collected events and the thread name
+     * @note Requires Output::lock and Collector::lock
+     */
+    void drain(Output& o, Collector& c)
+    {
+        if (!o.file.is_open())
+        {
+            c.events.clear();
+            return;
+        }
+        o.file << c.events;
+        c.events.clear();
+        std::string name;
+        json::quote(c.name, name);
+        o.file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << c.tid
+               << ",\"args\":{\"name\":" << name << "}},\n";
+    }
+
+    /**
+     * @brief Collector of the calling thread, registered while the thread runs
+     */
+    Collector& local()
+    {
+        struct Holder
+        {
+            Collector collector;
+            Holder()
+            {
+                Output& o = output();
+                std::lock_guard<std::mutex> lock(o.lock);
+                collector.name = "thread";
+                collector.tid = o.next_tid++;
+                o.threads.push_back(&collector);
+            }
+            ~Holder()
+            {
+                Output& o = output();
+                std::lock_guard<std::mutex> lock(o.lock);
+                {
+                    std::lock_guard<std::mutex> events_lock(collector.lock);
+                    drain(o, collector);
+                }
+                o.threads.erase(std::find(o.threads.begin(), o.threads.end(), &collector));
+            }
+        };
+        static thread_local Holder holder;
+        return holder.collector;
+    }
+
+    /**
+     * @brief Append nanoseconds as microseconds with 3 decimals
+     */
+    void append_us(std::string& out, int64_t ns)
+    {
+        char buf[32];
+        int n = std::snprintf(buf, sizeof(buf), "%lld.%03lld",
+                              static_cast<long long>(ns / 1000), static_cast<long long>(ns % 1000));
+        out.append(buf, n);
+    }
+}
+
+namespace trace
+{
+    bool start(const std::string& filename)
+    {
+        if (!stats::compiled())
+            return false;
+        Output& o = output();
+        {
+            std::lock_guard<std::mutex> lock(o.lock);
+            if (o.file.is_open())
+                o.file.close();
+            o.file.open(filename, std::ios::out | std::ios::trunc);
+            if (!o.file.good())
+            {
+                o.file.close();
+                return false;
+            }
+            o.file << "{\"traceEvents\":[\n";
+            o.origin.store(now(), std::memory_order_relaxed);
+            for (auto c : o.threads)
+            {
+                std::lock_guard<std::mutex> events_lock(c->lock);
+                c->events.clear();  // left from the previous trace
+            }
+        }
+        stats::tracing.store(true);
+        return true;
+    }
+
+    bool stop()
+    {
+        Output& o = output();
+        stats::tracing.store(false);
+        std::lock_guard<std::mutex> lock(o.lock);
+        if (!o.file.is_open())
+            return false;
+        for (auto c : o.threads)
+        {
+            std::lock_guard<std::mutex> events_lock(c->lock);
+            drain(o, *c);
+        }
+        o.file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"ctex\"}}\n"
+               << "],\"displayTimeUnit\":\"ms\"}\n";
+        o.file.close();
+        return !o.file.fail();
+    }
+
+    void set_thread_name(const std::string& name)
+    {
+        if (!stats::compiled())
+            return;
+        Collector& c = local();
+        std::lock_guard<std::mutex> lock(c.lock);
+        c.name = name;
+    }
+
+    void complete(const char* category, const char* name, int64_t begin, int64_t end,
+                  const std::string& detail)
+    {
+        if (!enabled())
+            return;
+        Output& o = output();
+        Collector& c = local();
+        int64_t origin = o.origin.load(std::memory_order_relaxed);
+        begin = std::max(begin, origin);    // started before the trace
+        end = std::max(end, begin);
+        std::string full;
+        {
+            std::lock_guard<std::mutex> lock(c.lock);
+            std::string& e = c.events;
+            e += "{\"name\":\"";
+            e += name;
+            e += "\",\"cat\":\"";
+            e += category;
+            e += "\",\"ph\":\"X\",\"pid\":1,\"tid\":";
+            e += std::to_string(c.tid);
+            e += ",\"ts\":";
+            append_us(e, begin - origin);
+            e += ",\"dur\":";
+            append_us(e, end - begin);
+            if (!detail.empty())
+            {
+                e += ",\"args\":{\"detail\":";
+                json::quote(detail, e);
+                e += '}';
+            }
+            e += "},\n";
+            if (e.size() < flush_size)
+                return;
+            full.swap(e);
+        }
+        // written without the collector lock, see the lock order
+        std::lock_guard<std::mutex> lock(o.lock);
+        if (o.file.is_open())
+            o.file << full;
+    }
+
+    int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+}
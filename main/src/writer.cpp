@@ -0,0 +1,204 @@
+/**
+ * @file writer.cpp
+ * @date 18.10.26
+ * @author galarius
+ * @copyright Copyright © 2017 galarius. All rights reserved.
+ * @brief Buffered output sink
+ */
+
+#include "writer.hpp"
+#include "stats.hpp"
+
+#include <cstring>
+#include <cerrno>
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#include <unistd.h>
+#include <climits>
+#endif
+
+namespace
+{
+#if !defined(_WIN32) && defined(IOV_MAX)
+    const size_t max_segments = IOV_MAX;
+#else
+    const size_t max_segments = 1024;
+#endif
+}
+
+Writer::Writer(std::ostream& out, size_t capacity) :
+out_(&out)
+, fd_(-1)
+, capacity_(capacity)
+, good_(true)
+{
+    buffer_.reserve(capacity_);
+}
+
+#ifndef _WIN32
+Writer::Writer(int fd, size_t capacity) :
+out_(nullptr)
+, fd_(fd)
+, capacity_(capacity)
+, good_(fd >= 0)
+{
+    buffer_.reserve(capacity_);
+}
+#endif
+
+Writer::~Writer()
+{
+    flush();
+}
+
+void Writer::write(const char* data, size_t size)
+{
+    if (buffer_.size() + size > capacity_)
+    {
+        drain();
+        if (size >= capacity_)
+        {
+            // too large to be buffered, pass it through
+            if (out_)
+            {
+                STATS_SCOPE(Output);
+                STATS_COUNT(OutputBytes, size);
+                out_->write(data, size);
+            }
+            else
+            {
+                segments_.push_back({ data, 0, size });
+                drain();
+            }
+            return;
+        }
+    }
+    if (!segments_.empty() && !segments_.back().ref)
+    {
+        segments_.back().size += size;
+    }
+    else
+    {
+        if (segments_.size() + 1 >= max_segments)
+        {
+            drain();
+        }
+        segments_.push_back({ nullptr, buffer_.size(), size });
+    }
+    buffer_.append(data, size);
+}
+
+void Writer::write_ref(const char* data, size_t size)
+{
+    if (!size)
+        return;
+    if (out_)
+    {
+        write(data, size);
+        return;
+    }
+    if (!segments_.empty() && segments_.back().ref &&
+        segments_.back().ref + segments_.back().size == data)
+    {
+        // continues the previous span
+        segments_.back().size += size;
+        return;
+    }
+    if (segments_.size() + 1 >= max_segments)
+    {
+        drain();
+    }
+    segments_.push_back({ data, 0, size });
+}
+
+void Writer::flush()
+{
+    STATS_SCOPE(Output);
+    drain();
+    if (out_)
+    {
+        out_->flush();
+        good_ = good_ && out_->good();
+    }
+}
+
+bool Writer::good() const
+{
+    return good_;
+}
+
+Writer& Writer::operator<<(const std::string& s)
+{
+    write(s.data(), s.size());
+    return *this;
+}
+
+Writer& Writer::operator<<(const char* s)
+{
+    write(s, std::strlen(s));
+    return *this;
+}
+
+Writer& Writer::operator<<(char c)
+{
+    write(&c, 1);
+    return *this;
+}
+
+void Writer::drain()
+{
+    STATS_SCOPE(Output);
+    if (stats::enabled())
+    {
+        size_t bytes = 0;
+        for (auto& s : segments_)
+            bytes += s.size;
+        stats::add(stats::OutputBytes, bytes);
+    }
+    if (out_)
+    {
+        for (auto& s : segments_)
+        {
+            out_->write(s.ref ? s.ref : buffer_.data() + s.offset, s.size);
+        }
+    }
+#ifndef _WIN32
+    else if (good_ && !segments_.empty())
+    {
+        std::vector<iovec> iov;
+        iov.reserve(segments_.size());
+        for (auto& s : segments_)
+        {
+            const char* p = s.ref ? s.ref : buffer_.data() + s.offset;
+            iov.push_back({ const_cast<char*>(p), s.size });
+        }
+        size_t first = 0;
+        while (first < iov.size())
+        {
+            ssize_t n = ::writev(fd_, &iov[first], static_cast<int>(iov.size() - first));
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                good_ = false;
+                break;
+            }
+            // skip written spans, adjust partially written one
+            size_t written = static_cast<size_t>(n);
+            while (first < iov.size() && written >= iov[first].iov_len)
+            {
+                written -= iov[first].iov_len;
+                ++first;
+            }
+            if (first < iov.size())
+            {
+                iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + written;
+                iov[first].iov_len -= written;
+            }
+        }
+    }
+#endif
+    segments_.clear();
+    buffer_.clear();
+}
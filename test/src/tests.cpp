@@ -1,23 +1,57 @@
 #define CATCH_CONFIG_RUNNER
 #include "catch.hpp"
-#define __glogger_implementation__
 #include "glogger.hpp"
 
 #include <memory>
+#include <sstream>
+#include <fstream>
 
 #include "ctex.hpp"
+#include "detector.hpp"
+#include "writer.hpp"
+#include "hash.hpp"
+#include "manifest.hpp"
+#include "diskcache.hpp"
+#include "sharedcache.hpp"
+#include "service.hpp"
+#include "batch.hpp"
+#include "json.hpp"
+#include "preview.hpp"
+#include "ctex.h"
+#include "trace.hpp"
+#include "threadpool.hpp"
+
+#include <thread>
+#include <map>
+#include <future>
+#include <regex>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 std::shared_ptr<CTex> ctex;
 
 std::string run(const std::string& cformula)
 {
     GLogger::instance().logInfo("in: ", cformula);
-    std::string latex_formula = ctex->translate(cformula, CTex::DISPLAY);
+    std::string latex_formula = ctex->translate(cformula, CTex::DISPLAY).latex;
     GLogger::instance().logInfo("out: ", latex_formula);
     GLogger::instance().logInfo("");
     return latex_formula;
 }
 
+std::string detect(const std::string& code, int min_op_count = 0, int min_fn_count = 0)
+{
+    std::istringstream in(code);
+    std::ostringstream out;
+    Detector detector(ctex);
+    detector.set_filter(min_op_count, min_fn_count);
+    detector.perform(in, out);
+    return out.str();
+}
+
 TEST_CASE("handle underscore") {
     REQUIRE(
         run("y = x_1;").compare(R"!($$ y = x{\_}1 $$)!") == 0
@@ -48,6 +82,873 @@ TEST_CASE("handle pow" ) {
     );
 }
 
+TEST_CASE("translation statistics" ) {
+    auto res = ctex->translate("y = sqrt(x * x);", CTex::DISPLAY);
+    REQUIRE(res.group_hits("operator") == 2);
+    REQUIRE(res.group_hits("function") == 1);
+    REQUIRE(res.group_hits("unknown") == 0);
+    REQUIRE(res.diagnostics.empty());
+}
+
+TEST_CASE("detector filter" ) {
+    const std::string code = "i = 0;\ny = sqrt(x * x);\n";
+    auto out = detect(code, 1, 0);
+    REQUIRE(out.find("Input: i = 0;") == std::string::npos);
+    REQUIRE(out.find("Input: y = sqrt(x * x);") != std::string::npos);
+    out = detect(code, 5, 1);
+    REQUIRE(out == code);
+}
+
+TEST_CASE("custom grammar filter" ) {
+    // `plus` is an operator of this grammar, but not of the lexeme library
+    auto custom = std::make_shared<CTex>(std::vector<std::pair<std::string, std::string>>({
+        { R"!(plus|\=)!", "operator" },
+        { R"!([a-zA-Z0-9_]+)!", "variable" } }));
+    REQUIRE(!custom->default_grammar());
+    REQUIRE(ctex->default_grammar());
+    std::istringstream in("y = a plus b;\n");
+    std::ostringstream out;
+    Detector detector(custom);
+    detector.set_filter(1, 0);
+    detector.perform(in, out);
+    REQUIRE(out.str().find("Input: y = a plus b;") != std::string::npos);
+}
+
+TEST_CASE("buffered writer" ) {
+    std::ostringstream out;
+    {
+        Writer writer(out, 4);
+        writer << "ab" << 'c';
+        REQUIRE(out.str().empty());
+        writer << "defgh";
+        REQUIRE(out.str() == "abcdefgh");
+        writer << "i";
+    }
+    REQUIRE(out.str() == "abcdefghi");
+}
+
+TEST_CASE("file passthrough" ) {
+    const std::string code = "/* c */\nint i; // x\r\ny = sqrt(x * x);\nz = a\n  + b;\nreturn 0;";
+    {
+        std::ofstream f("ctex_test_in.c", std::ios::binary);
+        f << code;
+    }
+    Detector detector(ctex);
+    REQUIRE(detector.perform("ctex_test_in.c", "ctex_test_out.c"));
+    std::ifstream result("ctex_test_out.c", std::ios::binary);
+    std::stringstream ss;
+    ss << result.rdbuf();
+    REQUIRE(ss.str() == detect(code));
+    // output to the input file itself, even through a link, replaces it
+    REQUIRE(detector.perform("ctex_test_in.c", "ctex_test_in.c"));
+    std::ifstream same("ctex_test_in.c", std::ios::binary);
+    std::stringstream same_text;
+    same_text << same.rdbuf();
+    REQUIRE(same_text.str() == detect(code));
+#ifndef _WIN32
+    {
+        std::ofstream f("ctex_test_in.c", std::ios::binary);
+        f << code;
+    }
+    std::remove("ctex_test_link.c");
+    REQUIRE(symlink("ctex_test_in.c", "ctex_test_link.c") == 0);
+    REQUIRE(detector.perform("ctex_test_link.c", "ctex_test_in.c"));
+    std::ifstream linked("ctex_test_in.c", std::ios::binary);
+    std::stringstream linked_text;
+    linked_text << linked.rdbuf();
+    REQUIRE(linked_text.str() == detect(code));
+    std::remove("ctex_test_link.c");
+#endif
+}
+
+TEST_CASE("lazy grammar" ) {
+    int created = 0;
+    Detector detector([&]() {
+        ++created;
+        return ctex;
+    });
+    std::ostringstream stream;
+    {
+        Writer out(stream);
+        detector.perform("int i;\nreturn 0;\n", 17, out);
+    }
+    REQUIRE(created == 0);
+    REQUIRE(stream.str() == "int i;\nreturn 0;\n");
+    std::istringstream in("y = sqrt(x * x);\nz = a * b;\n");
+    stream.str("");
+    detector.perform(in, stream);
+    REQUIRE(created == 1);
+    REQUIRE(stream.str() == detect(in.str()));
+}
+
+TEST_CASE("idempotent rerun" ) {
+    const std::string code = "int f() {\n    y = sqrt(x * x);\n    return 0;\n}\n";
+    auto out = detect(code);
+    REQUIRE(detect(out) == out);
+    auto changed = out;
+    changed.replace(changed.rfind("x * x"), 5, "x * z");
+    out = detect(changed);
+    REQUIRE(out.find("Input:     y = sqrt(x * z);") != std::string::npos);
+    REQUIRE(out.find("x \\cdot x") == std::string::npos);
+    REQUIRE(out.find("/** CTEX") == out.rfind("/** CTEX"));
+    // blocks of other settings are not reused
+    std::string plain = code;
+    plain.replace(plain.rfind("x * x"), 5, "x * z");
+    REQUIRE(detect(out, 100, 100) == plain);
+    REQUIRE(detect(detect(out, 100, 100)) == out);
+    REQUIRE(detect(out, 1, 0) != out);
+    REQUIRE(detect(detect(out, 1, 0)) == out);
+}
+
+TEST_CASE("in-place rewrite" ) {
+    {
+        std::ofstream f("ctex_test_in.c", std::ios::binary);
+        f << "y = sqrt(x * x);\n";
+    }
+    Detector detector(ctex);
+    bool changed = false;
+    REQUIRE(detector.perform_in_place("ctex_test_in.c", changed));
+    REQUIRE(changed);
+    REQUIRE(detector.perform_in_place("ctex_test_in.c", changed));
+    REQUIRE(!changed);
+#ifndef _WIN32
+    // the link target is rewritten, the link stays
+    {
+        std::ofstream f("ctex_test_in.c", std::ios::binary);
+        f << "y = sqrt(x * x);\n";
+    }
+    std::remove("ctex_test_link.c");
+    REQUIRE(symlink("ctex_test_in.c", "ctex_test_link.c") == 0);
+    REQUIRE(detector.perform_in_place("ctex_test_link.c", changed));
+    REQUIRE(changed);
+    struct stat st;
+    REQUIRE(lstat("ctex_test_link.c", &st) == 0);
+    REQUIRE(S_ISLNK(st.st_mode));
+    std::ifstream in("ctex_test_in.c");
+    std::stringstream text;
+    text << in.rdbuf();
+    REQUIRE(text.str().find("CTEX") != std::string::npos);
+    std::remove("ctex_test_link.c");
+#endif
+}
+
+TEST_CASE("xxh64" ) {
+    REQUIRE(hash::xxh64("") == 0xEF46DB3751D8E999ULL);
+    REQUIRE(hash::xxh64("Nobody inspects the spammish repetition") == 0xFBCEA83C8A378BF1ULL);
+}
+
+TEST_CASE("manifest" ) {
+    auto manifest = std::make_shared<Manifest>();
+    manifest->update("dir/a file.c", { 1, 2, 3 });
+    REQUIRE(manifest->save("ctex_test.manifest"));
+    Manifest loaded;
+    Manifest::Entry entry;
+    REQUIRE(loaded.load("ctex_test.manifest"));
+    REQUIRE(loaded.find("dir/a file.c", entry));
+    REQUIRE((entry.input_hash == 1 && entry.fingerprint == 2 && entry.output_hash == 3));
+    
+    {
+        std::ofstream f("ctex_test_in.c", std::ios::binary);
+        f << "y = sqrt(x * x);\n";
+    }
+    Detector detector(ctex);
+    detector.set_manifest(manifest);
+    REQUIRE(detector.perform("ctex_test_in.c", "ctex_test_out.c"));
+    REQUIRE(manifest->find("ctex_test_in.c", entry));
+    REQUIRE(entry.fingerprint == detector.fingerprint());
+    if (stats::compiled())
+    {
+        // unchanged file is skipped, changed one is translated again
+        stats::enable(true);
+        uint64_t formulas = stats::snapshot().counters[stats::Formulas];
+        REQUIRE(detector.perform("ctex_test_in.c", "ctex_test_out.c"));
+        REQUIRE(stats::snapshot().counters[stats::Formulas] == formulas);
+        {
+            std::ofstream f("ctex_test_in.c", std::ios::binary);
+            f << "y = sqrt(x * z);\n";
+        }
+        REQUIRE(detector.perform("ctex_test_in.c", "ctex_test_out.c"));
+        REQUIRE(stats::snapshot().counters[stats::Formulas] == formulas + 1);
+        stats::enable(false);
+    }
+    detector.set_filter(1, 1);
+    REQUIRE(detector.fingerprint() != entry.fingerprint);
+}
+
+TEST_CASE("disk cache" ) {
+    std::remove("ctex_test.cache");
+    {
+        DiskCache cache(64);
+        REQUIRE(cache.open("ctex_test.cache"));
+        cache.store(1, "a", { "A", { 1, 2 } });
+        cache.store(2, "b", { std::string(100, 'B'), { 3 } });
+        REQUIRE(cache.save());
+    }
+    DiskCache cache(64);
+    DiskCache::Value value;
+    REQUIRE(cache.open("ctex_test.cache"));
+    REQUIRE(cache.size() == 1);     // the large entry exceeds the limit
+    REQUIRE(cache.lookup(1, "a", value));
+    REQUIRE((value.latex == "A" && value.hits == std::vector<int>{ 1, 2 }));
+    REQUIRE(!cache.lookup(1, "collision", value));
+    {
+        // concurrent runs keep each other's entries
+        DiskCache first(64), second(64);
+        REQUIRE((first.open("ctex_test.cache") && second.open("ctex_test.cache")));
+        first.store(3, "c", { "C", { } });
+        second.store(4, "d", { "D", { } });
+        REQUIRE((first.save() && second.save()));
+        DiskCache merged(64);
+        REQUIRE(merged.open("ctex_test.cache"));
+        REQUIRE(merged.size() == 3);
+        REQUIRE((merged.lookup(3, "c", value) && merged.lookup(4, "d", value)));
+        // unchanged cache is not written
+        std::remove("ctex_test.cache");
+        DiskCache unchanged(64);
+        REQUIRE(unchanged.open("ctex_test.cache"));
+        REQUIRE(unchanged.save());
+        REQUIRE(!MappedFile("ctex_test.cache").good());
+    }
+    std::remove("ctex_test.cache.lock");
+    
+    auto cached = std::make_shared<CTex>(CTex::default_regex());
+    cached->set_disk_cache(std::make_shared<DiskCache>());
+    auto first = cached->translate("y = sqrt(x * x);", CTex::DISPLAY);
+    auto second = cached->translate("y =  sqrt(x * x); ", CTex::DISPLAY);
+    REQUIRE(first.latex == second.latex);
+    REQUIRE(second.group_hits("operator") == 2);
+    REQUIRE(second.group_hits("function") == 1);
+}
+
+TEST_CASE("memo" ) {
+    CTex memo(CTex::default_regex());
+    memo.set_memo_capacity(16);
+    auto first = memo.translate("y = a*b;", CTex::DISPLAY);
+    auto second = memo.translate("y = a * b;", CTex::DISPLAY);
+    REQUIRE(first.latex == second.latex);
+    auto stats = memo.memo_stats();
+    REQUIRE((stats.hits == 1 && stats.misses == 1 && stats.size == 1));
+    // capacity is not lost to the rounding of shards
+    memo.set_memo_capacity(20);
+    for (int i = 0; i < 400; ++i)
+        memo.translate("y = a * " + std::to_string(i) + ";", CTex::DISPLAY);
+    REQUIRE(memo.memo_stats().size == 20);
+    // extending the library makes memoized and cached translations stale
+    memo.set_disk_cache(std::make_shared<DiskCache>());
+    auto before = memo.translate("y = fmemo(x) + 1;", CTex::DISPLAY);
+    LexemeLibrary::add_lexeme("fmemo", LexemeLibrary::function, 1);
+    auto after = memo.translate("y = fmemo(x) + 1;", CTex::DISPLAY);
+    REQUIRE(before.latex != after.latex);
+    REQUIRE(after.latex == CTex(CTex::default_regex()).translate("y = fmemo(x) + 1;", CTex::DISPLAY).latex);
+    REQUIRE(LexemeLibrary::remove_lexeme("fmemo"));
+    REQUIRE(!LexemeLibrary::remove_lexeme("fmemo"));
+    REQUIRE(memo.translate("y = fmemo(x) + 1;", CTex::DISPLAY).latex == before.latex);
+}
+
+TEST_CASE("json" ) {
+    json::Value v;
+    REQUIRE(json::Value::parse(R"( {"id": 7, "s": "a\"\u00e9\ud83d\ude00", "a": [1.5, true, null, {}]} )", v));
+    REQUIRE(v["id"].as_number() == 7);
+    REQUIRE(v["s"].as_string() == "a\"\xc3\xa9\xf0\x9f\x98\x80");
+    REQUIRE(v["a"].items().size() == 4);
+    REQUIRE(v["missing"].is_null());
+    REQUIRE(v.dump() == R"({"id":7,"s":"a\")" "\xc3\xa9\xf0\x9f\x98\x80" R"(","a":[1.5,true,null,{}]})");
+    REQUIRE(!json::Value::parse("{\"id\": 1,}", v));
+    REQUIRE(!json::Value::parse("[1] 2", v));
+}
+
+TEST_CASE("batch" ) {
+    std::string formulas;
+    for (int i = 0; i < 50; ++i)
+        formulas += "y = sqrt(x * " + std::to_string(i) + ");\n";
+    std::string expected;
+    for (int i = 0; i < 50; ++i)
+        expected += ctex->translate("y = sqrt(x * " + std::to_string(i) + ");").latex + '\n';
+    for (size_t threads : { 1, 3 })
+    {
+        std::istringstream in(formulas);
+        std::ostringstream stream;
+        Writer out(stream);
+        REQUIRE(Batch(ctex, threads).run(in, out, Batch::Lines) == 50);
+        out.flush();
+        REQUIRE(stream.str() == expected);
+    }
+    std::istringstream in("{\"id\": \"a\", \"formula\": \"y = a*b;\", \"style\": \"inline\"}\n\nnot json\n");
+    std::ostringstream stream;
+    Writer out(stream);
+    Batch(ctex).run(in, out, Batch::JsonLines);
+    out.flush();
+    REQUIRE(stream.str() == "{\"id\":\"a\",\"latex\":\"$ y = a \\\\cdot b $\"}\n"
+                            "{\"id\":null,\"error\":\"invalid JSON request\"}\n");
+}
+
+TEST_CASE("preview server" ) {
+    Detector detector(ctex);
+    PreviewServer server(detector);
+    std::string response;
+    auto call = [&](const std::string& method, const std::string& params) -> json::Value {
+        server.handle(R"({"jsonrpc":"2.0","id":1,"method":")" + method + R"(","params":)" + params + "}", response);
+        json::Value reply;
+        json::Value::parse(response, reply);
+        return reply;
+    };
+    auto opened = call("open", R"({"uri":"a.c","text":"int f() {\n    y = a*b;\n    z = sqrt(x);\n}\n"})");
+    REQUIRE(opened["result"]["changed"].items().size() == 2);
+    REQUIRE(opened["result"]["changed"].items()[1]["line"].as_number() == 2);
+    // unchanged statements are not translated again
+    auto shifted = call("change", R"({"uri":"a.c","edits":[{"start":0,"end":0,"text":"\n"}]})");
+    REQUIRE(shifted["result"]["changed"].items().empty());
+    REQUIRE(shifted["result"]["moved"].items().size() == 2);
+    auto edited = call("change", R"({"uri":"a.c","edits":[{"start":3,"end":4,"text":"    z = sqrt(x * x);\n"}]})");
+    REQUIRE(edited["result"]["changed"].items().size() == 1);
+    REQUIRE(edited["result"]["changed"].items()[0]["latex"].as_string() ==
+            ctex->translate("    z = sqrt(x * x);").latex);
+    REQUIRE(edited["result"]["removed"].items()[0].as_number() == 2);
+    REQUIRE(call("change", R"({"uri":"a.c","edits":[{"start":9,"end":10,"text":""}]})")["error"]["code"].as_number() == -32602);
+    REQUIRE(!server.handle(R"({"jsonrpc":"2.0","method":"shutdown"})", response));
+    REQUIRE(response.empty());
+}
+
+TEST_CASE("preview incremental" ) {
+    Detector detector(ctex);
+    detector.set_filter(1, 0);
+    std::string response;
+    auto call = [&](PreviewServer& server, const std::string& method, const json::Value& params) -> json::Value {
+        json::Value request = json::Value::object();
+        request.set("jsonrpc", "2.0");
+        request.set("id", 1);
+        request.set("method", method);
+        request.set("params", params);
+        server.handle(request.dump(), response);
+        json::Value reply;
+        json::Value::parse(response, reply);
+        return reply["result"];
+    };
+    auto text_of = [](const std::vector<std::string>& lines) {
+        std::string text;
+        for (auto& l : lines)
+            text += l + '\n';
+        return text;
+    };
+    auto params = [](const std::string& text) {
+        json::Value p = json::Value::object();
+        p.set("uri", "a.c");
+        p.set("text", text);
+        return p;
+    };
+    // statements as the client sees them: line and input by id
+    std::map<double, std::pair<double, std::string>> shown;
+    auto apply = [&](const json::Value& result) {
+        for (auto& r : result["removed"].items())
+            REQUIRE(shown.erase(r.as_number()) == 1);
+        for (auto& m : result["moved"].items())
+            shown.at(m["id"].as_number()).first = m["line"].as_number();
+        for (auto& c : result["changed"].items())
+            shown[c["id"].as_number()] = { c["line"].as_number(), c["input"].as_string() };
+    };
+    std::vector<std::string> lines = { "int f() {", "    i = 0;", "    y = a*b;", "    z = sqrt(x);",
+                                       "    w = a +", "        b * c;", "}" };
+    PreviewServer server(detector);
+    apply(call(server, "open", params(text_of(lines))));
+    REQUIRE(shown.size() == 3);     // `i = 0;` is rejected by the filter
+    // replace lines [start, end) in the server and in the expected text
+    auto edit = [&](size_t start, size_t end, const std::string& text) {
+        json::Value e = json::Value::object();
+        e.set("start", static_cast<double>(start));
+        e.set("end", static_cast<double>(end));
+        e.set("text", text);
+        json::Value edits = json::Value::array();
+        edits.push(e);
+        json::Value p = json::Value::object();
+        p.set("uri", "a.c");
+        p.set("edits", edits);
+        apply(call(server, "change", p));
+        lines.erase(lines.begin() + start, lines.begin() + end);
+        if (!text.empty())
+            lines.insert(lines.begin() + start, text.substr(0, text.size() - 1));
+        // the same statements, as a full scan of a new document finds
+        PreviewServer fresh(detector);
+        auto expected = call(fresh, "open", params(text_of(lines)))["changed"].items();
+        std::map<double, std::string> by_line;
+        for (auto& s : shown)
+            by_line[s.second.first] = s.second.second;
+        REQUIRE(by_line.size() == expected.size());
+        size_t i = 0;
+        for (auto& s : by_line)
+        {
+            INFO(text_of(lines));
+            REQUIRE(s.first == expected[i]["line"].as_number());
+            REQUIRE(s.second == expected[i]["input"].as_string());
+            ++i;
+        }
+    };
+    // an open comment hides the statements after the scanned lines
+    edit(1, 1, "/*\n");
+    REQUIRE(shown.empty());
+    edit(1, 2, "");
+    REQUIRE(shown.size() == 3);
+    const char* inserts[] = { "    q = a - b;", "/* y = a*b;", "*/", "    u = a", "", "    v = c * d;" };
+    uint32_t seed = 7;
+    for (int step = 0; step < 100; ++step)
+    {
+        seed = seed * 1103515245 + 12345;
+        size_t start = (seed >> 8) % (lines.size() + 1);
+        size_t end = std::min(lines.size(), start + (seed >> 16) % 2);
+        edit(start, end, step % 5 ? std::string(inserts[(seed >> 4) % 6]) + '\n' : std::string());
+    }
+}
+
+TEST_CASE("c api" ) {
+    REQUIRE(ctex_api_version() == CTEX_API_VERSION);
+    ctex_grammar* g = ctex_create();
+    REQUIRE(g != nullptr);
+    const std::string expected = ctex->translate("y = sqrt(x);", CTex::INLINE).latex;
+    char small[4];
+    REQUIRE(ctex_translate(g, "y = sqrt(x);", CTEX_STYLE_INLINE, small, sizeof(small)) == long(expected.size()));
+    REQUIRE(std::string(small) == expected.substr(0, 3));
+    REQUIRE(ctex_translate(g, "y = sqrt(x);", 42, small, sizeof(small)) == -1);
+    // lexemes of the command line tool
+    char fsign[64];
+    REQUIRE(ctex_translate(g, "y = fsign(x);", CTEX_STYLE_INLINE, fsign, sizeof(fsign)) > 0);
+    REQUIRE(std::string(fsign).find("fsign \\left(x\\right)") != std::string::npos);
+    
+    const char* formulas[] = { "y = sqrt(x);", "z = a * b;" };
+    size_t offsets[2];
+    long size = ctex_translate_batch(g, formulas, 2, CTEX_STYLE_INLINE, 2, nullptr, 0, nullptr);
+    std::vector<char> buffer(size);
+    REQUIRE(ctex_translate_batch(g, formulas, 2, CTEX_STYLE_INLINE, 2, buffer.data(), buffer.size(), offsets) == size);
+    REQUIRE(std::string(&buffer[offsets[0]]) == expected);
+    REQUIRE(std::string(&buffer[offsets[1]]) == ctex->translate("z = a * b;", CTex::INLINE).latex);
+    
+    const std::string code = "int f() {\n    y = sqrt(x * x);\n}\n";
+    long length = ctex_process(g, code.data(), code.size(), nullptr, 0);
+    std::vector<char> processed(length + 1);
+    REQUIRE(ctex_process(g, code.data(), code.size(), processed.data(), processed.size()) == length);
+    // the grammar of the library includes the lexemes added since ctex was built
+    std::istringstream in(code);
+    std::ostringstream out;
+    Detector(std::make_shared<CTex>(CTex::default_regex())).perform(in, out);
+    REQUIRE(std::string(processed.data()) == out.str());
+    ctex_free(g);
+    // logging is changed only on request
+    REQUIRE(GLogger::instance().enabled(GLogger::Info));
+    REQUIRE(ctex_set_log_level(CTEX_LOG_OFF) == 0);
+    REQUIRE(!GLogger::instance().enabled(GLogger::Error));
+    REQUIRE(ctex_set_log_level(42) == -1);
+    REQUIRE(ctex_set_log_level(CTEX_LOG_INFO) == 0);
+    REQUIRE(GLogger::instance().enabled(GLogger::Info));
+    REQUIRE(!GLogger::instance().enabled(GLogger::Debug));
+}
+
+#ifndef _WIN32
+TEST_CASE("shared cache" ) {
+    std::remove("ctex_test.shm");
+    SharedCache writer(4, 1024);
+    SharedCache reader;     // attaches with the geometry of the existing table
+    REQUIRE(writer.open("ctex_test.shm"));
+    REQUIRE(reader.open("ctex_test.shm"));
+    DiskCache::Value value;
+    REQUIRE(!reader.lookup(7, "a", value));
+    REQUIRE(writer.store(7, "a", { "A", { 1, 2 } }));
+    REQUIRE(!writer.store(7, "a", { "A", { 1, 2 } }));
+    REQUIRE(reader.lookup(7, "a", value));
+    REQUIRE((value.latex == "A" && value.hits == std::vector<int>{ 1, 2 }));
+    REQUIRE(!reader.lookup(7, "collision", value));
+    REQUIRE(!writer.store(8, "b", { std::string(2048, 'B'), { 3 } }));   // data section is full
+    REQUIRE(reader.size() == 1);
+    
+    std::remove("ctex_test.shm");
+    
+    // two translators attached to the same table, like two processes
+    CTex first(CTex::default_regex()), second(CTex::default_regex());
+    auto table = std::make_shared<SharedCache>(64, 4096);
+    REQUIRE(table->open("ctex_test.shm"));
+    first.set_shared_cache(table);
+    auto translated = first.translate("y = sqrt(x * x);", CTex::DISPLAY);
+    auto attached = std::make_shared<SharedCache>();
+    REQUIRE(attached->open("ctex_test.shm"));
+    second.set_shared_cache(attached);
+    auto reused = second.translate("y =  sqrt(x * x); ", CTex::DISPLAY);
+    REQUIRE(reused.latex == translated.latex);
+    REQUIRE(reused.group_hits("function") == 1);
+    REQUIRE(attached->size() == 1);
+    std::remove("ctex_test.shm");
+}
+
+TEST_CASE("service" ) {
+    const std::string code = "int f() {\n    y = sqrt(x * x);\n    return 0;\n}\n";
+    Detector detector(ctex);
+    Service service(detector, 2);
+    REQUIRE(service.listen("ctex_test.sock"));
+    Service duplicate(detector, 1);
+    REQUIRE(!duplicate.listen("ctex_test.sock"));
+    std::thread server([&]() { service.run(); });
+    std::vector<std::string> results(8);
+    std::vector<std::thread> clients;
+    for (auto& result : results)
+    {
+        clients.emplace_back([&]() {
+            std::ostringstream out;
+            if (Service::request("ctex_test.sock", code.data(), code.size(), out))
+                result = out.str();
+        });
+    }
+    for (auto& c : clients)
+        c.join();
+    // oversized request is rejected with a reason
+    std::string huge((16 << 20) + 1, ' ');
+    std::ostringstream rejected;
+    std::string error;
+    REQUIRE(!Service::request("ctex_test.sock", huge.data(), huge.size(), rejected, &error));
+    REQUIRE(error.find("exceeds") != std::string::npos);
+    REQUIRE(rejected.str().empty());
+    service.stop();
+    server.join();
+    for (auto& result : results)
+        REQUIRE(result == detect(code));
+    std::ostringstream out;
+    REQUIRE(!Service::request("ctex_test_missing.sock", code.data(), code.size(), out));
+}
+#endif
+
+TEST_CASE("log level check" ) {
+    auto& logger = GLogger::instance();
+    REQUIRE(GLogger::compiled(GLogger::Error));
+    REQUIRE(GLogger::compiled(GLogger::Trace) == (GLOGGER_MIN_LEVEL == GLogger::Trace));
+    if (!GLogger::compiled(GLogger::Info))
+        return;
+    REQUIRE(!logger.enabled(GLogger::Debug));
+    REQUIRE(logger.enabled(GLogger::Info));
+    int calls = 0;
+    auto payload = [&]() { ++calls; return std::string("payload"); };
+    logger.start_record();
+    logger.logDebug("skipped ", payload);
+    REQUIRE(calls == 0);
+    logger.logInfo("written ", payload);
+    REQUIRE(calls == 1);
+    REQUIRE(logger.end_record().find("written payload") != std::string::npos);
+    logger.set_output_mode(GLogger::Off);
+    REQUIRE(!logger.enabled(GLogger::None));
+    logger.set_output_mode(GLogger::Console);
+}
+
+TEST_CASE("per-thread recording" ) {
+    if (!GLogger::compiled(GLogger::Info))
+        return;
+    auto& logger = GLogger::instance();
+    logger.set_output_mode(GLogger::Off);
+    std::vector<std::string> records(4);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&logger, &records, t]() {
+            logger.start_record();
+            for (int i = 0; i < 50; ++i)
+                logger.logInfo("thread ", t);
+            records[t] = logger.end_record();
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    logger.set_output_mode(GLogger::Console);
+    for (int t = 0; t < 4; ++t)
+    {
+        std::istringstream in(records[t]);
+        size_t count = 0;
+        for (std::string line; std::getline(in, line); ++count)
+            REQUIRE(line == "thread " + std::to_string(t));
+        REQUIRE(count == 50);
+    }
+    REQUIRE(!logger.enabled(GLogger::Debug));
+}
+
+TEST_CASE("async logger" ) {
+    if (!GLogger::compiled(GLogger::Info))
+        return;
+    auto& logger = GLogger::instance();
+    std::remove("ctex_test.log");
+    logger.set_output_mode(GLogger::File);
+    logger.set_log_filename("ctex_test.log");
+    auto count_lines = []() {
+        std::ifstream in("ctex_test.log");
+        size_t count = 0;
+        for (std::string line; std::getline(in, line); )
+            count += line.find("async message") != std::string::npos;
+        return count;
+    };
+    auto log_from_threads = [&logger]() {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([&logger, t]() {
+                for (int i = 0; i < 100; ++i)
+                    logger.logInfo("async message ", t, " ", i);
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+    };
+    // every message is written
+    logger.start_async(16, GLogger::Block);
+    log_from_threads();
+    logger.flush();
+    REQUIRE(count_lines() == 400);
+    logger.stop_async();
+    REQUIRE(logger.dropped() == 0);
+    // messages are written or counted
+    logger.start_async(2, GLogger::Count);
+    log_from_threads();
+    logger.stop_async();
+    REQUIRE(count_lines() + logger.dropped() == 800);
+    logger.set_output_mode(GLogger::Console);
+    std::remove("ctex_test.log");
+}
+
+TEST_CASE("timestamps" ) {
+    if (!GLogger::compiled(GLogger::Info))
+        return;
+    auto& logger = GLogger::instance();
+    std::remove("ctex_test.log");
+    logger.set_output_mode(GLogger::File);
+    logger.set_log_filename("ctex_test.log");
+    logger.set_timestamp_tick(std::chrono::milliseconds(1));
+    logger.logInfo("wall clock");
+    logger.set_monotonic_timestamps(true);
+    logger.logInfo("monotonic");
+    logger.set_monotonic_timestamps(false);
+    logger.set_timestamp_tick(std::chrono::seconds(1));
+    logger.flush();
+    logger.set_output_mode(GLogger::Console);
+    std::ifstream in("ctex_test.log");
+    std::stringstream text;
+    text << in.rdbuf();
+    REQUIRE(std::regex_search(text.str(), std::regex(R"(\[\w{3} \w{3} [ \d]\d \d\d:\d\d:\d\d\.\d{3} \d{4}\]: wall clock)")));
+    REQUIRE(std::regex_search(text.str(), std::regex(R"(\[\d+\.\d{9}\]: monotonic)")));
+    std::remove("ctex_test.log");
+}
+
+TEST_CASE("binary log" ) {
+    if (!GLogger::compiled(GLogger::Info))
+        return;
+    auto& logger = GLogger::instance();
+    logger.set_output_mode(GLogger::File);
+    logger.set_binary_log_filename("ctex_test.blog");
+    std::string text = "text";
+    for (int i = -1; i < 2; ++i)
+        logger.logInfo("literal ", text, " ", i, " ", 2.5, " ", 7u, " ", true, 'c', [&]() { return i * 10; });
+    logger.log("none");
+    logger.logInfo(std::string(20, ' '), "padded", std::string(8, ' '), "|", std::string(7, ' '), "|");
+    logger.set_binary_log_filename("");
+    logger.set_output_mode(GLogger::Console);
+    std::ifstream in("ctex_test.blog", std::ios::binary);
+    std::ostringstream out;
+    REQUIRE(GLogger::decode_binary(in, out));
+    std::regex line(R"((\w*): \[[^\]]+\]: (.*))");
+    std::vector<std::string> messages;
+    std::istringstream lines(out.str());
+    for (std::string l; std::getline(lines, l); )
+    {
+        std::smatch m;
+        REQUIRE(std::regex_match(l, m, line));
+        messages.push_back(m[1].str() + "|" + m[2].str());
+    }
+    REQUIRE(messages == std::vector<std::string>({
+        "Info|literal text -1 2.5 7 1c-10",
+        "Info|literal text 0 2.5 7 1c0",
+        "Info|literal text 1 2.5 7 1c10",
+        "|none",
+        "Info|" + std::string(20, ' ') + "padded" + std::string(8, ' ') + "|" + std::string(7, ' ') + "|"}));
+    std::istringstream damaged(std::string("GLOGBIN1\0\5\0\0\0\2", 14));
+    REQUIRE(!GLogger::decode_binary(damaged, out));
+    std::remove("ctex_test.blog");
+}
+
+TEST_CASE("flight recorder" ) {
+    if (!GLogger::compiled(GLogger::Trace) || !GLogger::compiled(GLogger::Error))
+        return;
+    auto& logger = GLogger::instance();
+    std::remove("ctex_test.log");
+    logger.set_output_mode(GLogger::File);
+    logger.set_log_filename("ctex_test.log");
+    logger.set_min_level(GLogger::File, GLogger::Warn);
+    logger.set_flight_recorder(4);
+    REQUIRE(logger.enabled(GLogger::Trace));
+    for (int i = 0; i < 10; ++i)
+        logger.logTrace("step ", i);
+    auto read_log = []() {
+        GLogger::instance().flush();
+        std::ifstream in("ctex_test.log");
+        std::stringstream text;
+        text << in.rdbuf();
+        return text.str();
+    };
+    REQUIRE(read_log().find("step") == std::string::npos);
+    logger.logError("failure");
+    std::string text = read_log();
+    REQUIRE(text.find("step 5") == std::string::npos);
+    for (int i = 6; i < 10; ++i)
+        REQUIRE(text.find("step " + std::to_string(i)) != std::string::npos);
+    REQUIRE(text.find("step 9") < text.find("failure"));
+    // messages, that are in the file already, are not repeated
+    logger.logTrace("context");
+    logger.logWarn("warned once");
+    logger.logError("second error");
+    text = read_log();
+    REQUIRE(text.find("warned once") != std::string::npos);
+    REQUIRE(text.find("warned once") == text.rfind("warned once"));
+    REQUIRE(text.find("context") < text.find("second error"));
+    // rings of running threads are written on demand
+    std::promise<void> logged, dumped;
+    std::thread worker([&]() {
+        logger.logDebug("worker context");
+        logged.set_value();
+        dumped.get_future().wait();
+    });
+    logged.get_future().wait();
+    logger.logDebug("main context");
+    logger.dump_flight_recorder();
+    dumped.set_value();
+    worker.join();
+    text = read_log();
+    REQUIRE(text.find("worker context") != std::string::npos);
+    REQUIRE(text.find("main context") != std::string::npos);
+    logger.set_flight_recorder(0);
+    logger.set_min_level(GLogger::File, GLogger::Trace);
+    logger.set_output_mode(GLogger::Console);
+    REQUIRE(!logger.enabled(GLogger::Debug));
+    std::remove("ctex_test.log");
+}
+
+TEST_CASE("log rotation" ) {
+    if (!GLogger::compiled(GLogger::Info))
+        return;
+    auto& logger = GLogger::instance();
+    auto size = [](const std::string& name) {
+        std::ifstream in(name, std::ios::binary | std::ios::ate);
+        return in.good() ? static_cast<long>(in.tellg()) : -1L;
+    };
+    for (auto name : {"ctex_test.log", "ctex_test.log.1", "ctex_test.log.2", "ctex_test.log.3"})
+        std::remove(name);
+    logger.set_output_mode(GLogger::File);
+    logger.set_max_log_file_size(1000);
+    logger.set_max_log_files(2);
+    logger.set_log_filename("ctex_test.log");
+    for (int i = 0; i < 100; ++i)
+        logger.logInfo("rotated message ", i);
+    logger.flush();
+    REQUIRE(size("ctex_test.log") >= 0);
+    REQUIRE(size("ctex_test.log.1") > 1000);
+    REQUIRE(size("ctex_test.log.1") < 1100);
+    REQUIRE(size("ctex_test.log.2") > 1000);
+    REQUIRE(size("ctex_test.log.3") == -1);
+    std::ifstream in("ctex_test.log.1");
+    std::stringstream text;
+    text << in.rdbuf();
+    REQUIRE(text.str().find("rotated message 99") == std::string::npos);
+#ifndef _WIN32
+    // a generation, that can't be replaced, keeps the log file in place
+    for (auto name : {"ctex_test.log", "ctex_test.log.1", "ctex_test.log.2"})
+        std::remove(name);
+    REQUIRE(mkdir("ctex_test.log.1", 0755) == 0);
+    std::ofstream("ctex_test.log.1/keep") << "keep";
+    logger.set_max_log_files(1);
+    logger.set_log_filename("ctex_test.log");
+    for (int i = 0; i < 100; ++i)
+        logger.logInfo("kept message ", i);
+    logger.flush();
+    std::ifstream kept("ctex_test.log");
+    std::stringstream kept_text;
+    kept_text << kept.rdbuf();
+    REQUIRE(kept_text.str().find("kept message 0") != std::string::npos);
+    REQUIRE(kept_text.str().find("kept message 99") != std::string::npos);
+    REQUIRE(kept_text.str().find("log rotation failed") != std::string::npos);
+    std::remove("ctex_test.log.1/keep");
+    std::remove("ctex_test.log.1");
+#endif
+    logger.set_max_log_file_size(2000000);
+    logger.set_max_log_files(5);
+    logger.set_output_mode(GLogger::Console);
+    for (auto name : {"ctex_test.log", "ctex_test.log.1", "ctex_test.log.2"})
+        std::remove(name);
+}
+
+TEST_CASE("stats" ) {
+    if (!stats::compiled())
+        return;
+    stats::enable(true);
+    stats::Snapshot before = stats::snapshot();
+    std::thread worker([]() {
+        Detector detector(std::make_shared<CTex>(CTex::default_regex()));
+        std::istringstream in("int main() {\n    y = sqrt(x) + pow(a, 2);\n}\n");
+        std::ostringstream out;
+        detector.perform(in, out);
+    });
+    worker.join();
+    stats::Snapshot after = stats::snapshot();
+    stats::enable(false);
+    REQUIRE(after.counters[stats::Files] == before.counters[stats::Files] + 1);
+    REQUIRE(after.counters[stats::Formulas] == before.counters[stats::Formulas] + 1);
+    REQUIRE(after.counters[stats::Tokens] > before.counters[stats::Tokens]);
+    REQUIRE(after.counters[stats::OutputBytes] > before.counters[stats::OutputBytes]);
+    for (auto stage : {stats::Detection, stats::Lexing, stats::Sorting, stats::Transform, stats::Formatting})
+        REQUIRE(after.calls[stage] > before.calls[stage]);
+    REQUIRE(after.calls[stats::TreeBuilding] == before.calls[stats::TreeBuilding] + 2);
+    // collecting is off
+    ctex->translate("y = x;");
+    REQUIRE(stats::snapshot().counters[stats::Formulas] == after.counters[stats::Formulas]);
+    std::ostringstream table, text;
+    stats::report(table, false);
+    REQUIRE(table.str().find("tree building") != std::string::npos);
+    stats::report(text, true);
+    json::Value report;
+    REQUIRE(json::Value::parse(text.str(), report));
+    REQUIRE(report["stages"]["lexing"]["calls"].as_number() >= 1);
+    REQUIRE(report["counters"]["formulas"].as_number() >= 1);
+}
+
+TEST_CASE("trace" ) {
+    if (!stats::compiled())
+        return;
+    stats::Snapshot before = stats::snapshot();
+    REQUIRE(trace::start("ctex_test_trace.json"));
+    {
+        ThreadPool pool(2);
+        for (int i = 0; i < 4; ++i)
+            pool.submit([i]() { ctex->translate("y = pow(x, " + std::to_string(i) + ");"); });
+        pool.wait();
+    }
+    REQUIRE(trace::stop());
+    // tracing alone collects no stats
+    REQUIRE(stats::snapshot().calls[stats::Lexing] == before.calls[stats::Lexing]);
+    ctex->translate("y = x;");     // not recorded
+    std::ifstream in("ctex_test_trace.json");
+    std::stringstream text;
+    text << in.rdbuf();
+    json::Value trace;
+    REQUIRE(json::Value::parse(text.str(), trace));
+    int formulas = 0, tasks = 0, lexing = 0, workers = 0;
+    for (auto& e : trace["traceEvents"].items())
+    {
+        const std::string& name = e["name"].as_string();
+        if (e["ph"].as_string() == "X")
+        {
+            REQUIRE(e["ts"].as_number() >= 0);
+            REQUIRE(e["dur"].as_number() >= 0);
+        }
+        formulas += name == "formula" ? 1 : 0;
+        tasks += name == "task" ? 1 : 0;
+        lexing += name == "lexing" && e["cat"].as_string() == "stage" ? 1 : 0;
+        workers += name == "thread_name" && e["args"]["name"].as_string() == "worker" ? 1 : 0;
+        if (name == "formula")
+            REQUIRE(e["args"]["detail"].as_string().find("pow(x, ") == 4);
+    }
+    REQUIRE(formulas == 4);
+    REQUIRE(tasks == 4);
+    REQUIRE(lexing == 4);
+    REQUIRE(workers == 2);
+    std::remove("ctex_test_trace.json");
+}
+
 int main( int argc, char* argv[] )
 {
     GLogger::instance().set_output_mode(GLogger::Console);